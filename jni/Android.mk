@@ -14,12 +14,17 @@ ANDROID_SOURCES_C := \
 	../src/intv.c \
 	../src/memory.c \
 	../src/cp1610.c \
+	../src/cp1610_jit.c \
 	../src/cart.c \
 	../src/controller.c \
 	../src/osd.c \
 	../src/ivoice.c \
 	../src/psg.c \
 	../src/stic.c \
+	../src/profile.c \
+	../src/trace.c \
+	../src/rewind.c \
+	../src/movie.c \
 	../src/stb_image_impl.c \
 	../src/deps/libretro-common/file/file_path.c \
 	../src/deps/libretro-common/file/file_path_io.c \
@@ -38,6 +43,6 @@ include $(CLEAR_VARS)
 LOCAL_MODULE    := retro
 LOCAL_SRC_FILES := $(ANDROID_SOURCES_C)
 LOCAL_C_INCLUDES := $(INCLUDE_DIRS)
-LOCAL_CFLAGS    := -DANDROID -D__LIBRETRO__ -DHAVE_STRINGS_H -DRIGHTSHIFT_IS_SAR
+LOCAL_CFLAGS    := -DANDROID -D__LIBRETRO__ -DHAVE_STRINGS_H -DRIGHTSHIFT_IS_SAR -DHAVE_STIC_THREAD
 LOCAL_LDFLAGS   := -Wl,-version-script=$(CORE_DIR)/link.T
 include $(BUILD_SHARED_LIBRARY)
@@ -0,0 +1,40 @@
+#ifndef BENCH_H
+#define BENCH_H
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Subsystem timers for the headless benchmark (make freeintv_bench).
+// In the core they compile to the plain call.
+
+enum { BENCH_STIC, BENCH_PSG, BENCH_IVOICE, BENCH_TIMERS };
+
+#ifdef FREEINTV_BENCHMARK
+
+extern double BenchTime[BENCH_TIMERS]; // seconds spent in each subsystem
+
+double BenchClock(void);
+
+#define BENCH(id, call) do { double bench_t = BenchClock(); call; BenchTime[id] += BenchClock() - bench_t; } while(0)
+
+#else
+
+#define BENCH(id, call) call
+
+#endif
+
+#endif
@@ -17,6 +17,7 @@
 */
 
 #include <stdio.h>
+#include "machine.h"
 #include "memory.h"
 #include "cart.h"
 #include "osd.h"
@@ -25,29 +26,23 @@
 #include <streams/file_stream.h>
 #endif
 
-int isIntellicart(void);
-int loadIntellicart(void);
-int isROM(void);
-int loadROM(void);
-int getLoadMethod(void);
-void load0(void);
-void load1(void);
-void load2(void);
-void load3(void);
-void load4(void);
-void load5(void);
-void load6(void);
-void load7(void);
-void load8(void);
-void load9(void);
-
-int data[0x20000]; // rom data loaded from file
-
-int size = 0; // size of file read
-
-int pos = 0; // current position in data
-
-int LoadCart(const char *path)
+int isIntellicart(intv_machine *m);
+int loadIntellicart(intv_machine *m);
+int isROM(intv_machine *m);
+int loadROM(intv_machine *m);
+int getLoadMethod(intv_machine *m);
+void load0(intv_machine *m);
+void load1(intv_machine *m);
+void load2(intv_machine *m);
+void load3(intv_machine *m);
+void load4(intv_machine *m);
+void load5(intv_machine *m);
+void load6(intv_machine *m);
+void load7(intv_machine *m);
+void load8(intv_machine *m);
+void load9(intv_machine *m);
+
+int LoadCart(intv_machine *m, const char *path)
 {
 	unsigned char word[1];
 
@@ -59,25 +54,26 @@ int LoadCart(const char *path)
 
     printf("[INFO] [FREEINTV] Attempting to load cartridge ROM from: %s\n", path);		
 
-	size = 0;
+	m->cart_size = 0;
+	m->cart_map = -1;
 
 #ifdef __LIBRETRO__
 	if((fp = filestream_open(path, RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE)) != NULL)
 	{
-		while(filestream_read(fp, word, sizeof(word)) == sizeof(word) && size<0x20000)
+		while(filestream_read(fp, word, sizeof(word)) == sizeof(word) && m->cart_size<0x20000)
 		{
-			data[size] = word[0];
-			size++;
+			m->cart_data[m->cart_size] = word[0];
+			m->cart_size++;
 		}
         filestream_close(fp);
-        printf("[INFO] [FREEINTV] Cartridge load complete: %d bytes read\n", size);
+        printf("[INFO] [FREEINTV] Cartridge load complete: %d bytes read\n", m->cart_size);
 #else
 	if((fp = fopen(path,"rb"))!=NULL)
 	{
-		while(fread(word,sizeof(word),1,fp) && size<0x20000)
+		while(fread(word,sizeof(word),1,fp) && m->cart_size<0x20000)
 		{
-			data[size] = word[0];
-			size++;
+			m->cart_data[m->cart_size] = word[0];
+			m->cart_size++;
 		}
         fclose(fp);
         if (feof(fp))
@@ -91,40 +87,41 @@ int LoadCart(const char *path)
 #endif
 
 		OSD_drawText(8, 7, "SIZE:");
-		OSD_drawInt(14, 7, size, 10);
+		OSD_drawInt(14, 7, m->cart_size, 10);
 
-        if(isIntellicart()) // intellicart format
+        if(isIntellicart(m)) // intellicart format
         {
 			OSD_drawText(8, 8, "INTELLICART");
             printf("[INFO] [FREEINTV] Intellicart cartridge format detected\n");		
-            return loadIntellicart();
+            return loadIntellicart(m);
         }
         else
         {
-			if(isROM())
+			if(isROM(m))
 			{
 				OSD_drawText(8, 8, "INTELLICART");
 				OSD_drawText(8, 9, "MISSING A8!");
 				printf("[INFO] [FREEINTV] Possible Intellicart cartridge format detected\n");
-				return loadROM();
+				return loadROM(m);
 			}
 			else
 			{
 				// check cartinfo database for load method
 				printf("[INFO] [FREEINTV] Raw ROM image. Determining load method via database.\n");		
-				switch(getLoadMethod())
+				m->cart_map = getLoadMethod(m);
+				switch(m->cart_map)
 				{
-						case 0: load0(); break;
-						case 1: load1(); break;
-						case 2: load2(); break;
-						case 3: load3(); break;
-						case 4: load4(); break;
-						case 5: load5(); break;
-						case 6: load6(); break;
-						case 7: load7(); break;
-						case 8: load8(); break;
-						case 9: load9(); break;
-						default: printf("[INFO] [FREEINTV] No database match. Using default cartridge memory map.\n"); load0();
+						case 0: load0(m); break;
+						case 1: load1(m); break;
+						case 2: load2(m); break;
+						case 3: load3(m); break;
+						case 4: load4(m); break;
+						case 5: load5(m); break;
+						case 6: load6(m); break;
+						case 7: load7(m); break;
+						case 8: load8(m); break;
+						case 9: load9(m); break;
+						default: printf("[INFO] [FREEINTV] No database match. Using default cartridge memory map.\n"); load0(m);
 				}
 			}
         }
@@ -137,130 +134,131 @@ int LoadCart(const char *path)
     }
 }
 
-int readWord(void)
+int readWord(intv_machine *m)
 {
    int val;
 
-	pos = pos * (pos<size);
-	val = (data[pos]<<8) | data[pos+1];
-	pos+=2;
+	m->cart_pos = m->cart_pos * (m->cart_pos<m->cart_size);
+	val = (m->cart_data[m->cart_pos]<<8) | m->cart_data[m->cart_pos+1];
+	m->cart_pos+=2;
 	return val;
 }
 
-void loadRange(int start, int stop)
+void loadRange(intv_machine *m, int start, int stop)
 {
-	while(start<=stop && pos<size) // load segment
+	while(start<=stop && m->cart_pos<m->cart_size) // load segment
 	{
-		Memory[start] = readWord();
+		m->Memory[start] = readWord(m);
 		start++;
 	}
 }
 
 // http://spatula-city.org/~im14u2c/intv/jzintv-1.0-beta3/doc/rom_fmt/IntellicartManual.booklet.pdf
-int isIntellicart() // check for intellicart format rom
+int isIntellicart(intv_machine *m) // check for intellicart format rom
 {
 	// check magic number (used for intellicart baud rate detection)
-	return (data[0]==0xA8); 
+	return (m->cart_data[0]==0xA8); 
 }
 
-int isROM() // some Intellicart roms don't start with A8 for no apparent reason
+int isROM(intv_machine *m) // some Intellicart roms don't start with A8 for no apparent reason
 {
 	// the third byte should be the 1's compliment of the second byte
-	return data[1] == (data[2]^0xFF);
+	return m->cart_data[1] == (m->cart_data[2]^0xFF);
 }
 
-int loadIntellicart() // load intellicart format rom
+int loadIntellicart(intv_machine *m) // load intellicart format rom
 {
 	int start;
 	int stop;
 	int i, t;
 	int segments;
 
-	pos = 0;
-	segments = readWord() & 0xFF; // number of non-contiguous rom segments (drop magic number)
-	pos++; // 1's compliment of segments (ignore)
+	m->cart_pos = 0;
+	segments = readWord(m) & 0xFF; // number of non-contiguous rom segments (drop magic number)
+	m->cart_pos++; // 1's compliment of segments (ignore)
 
 	for(i=0; i<segments; i++)
 	{
-		t = readWord(); // high bytes of segment start and stop addresses
+		t = readWord(m); // high bytes of segment start and stop addresses
 		start = t & 0xFF00;
 		stop = ((t<<8) & 0xFF00) | 0xFF;
-		loadRange(start, stop);
-		t = readWord(); // CRC for segment (ignored)
+		loadRange(m, start, stop);
+		t = readWord(m); // CRC for segment (ignored)
 	}
 	// Enable tables (ignored)
 	return 1;
 }
 
-int loadROM() // load ROM formatted cart
+int loadROM(intv_machine *m) // load ROM formatted cart
 {
-	return loadIntellicart();
+	return loadIntellicart(m);
 }
 
 // http://atariage.com/forums/topic/203179-config-files-to-use-with-various-intellivision-titles/
 
-void load0() // default - handles majority of carts
+void load0(intv_machine *m) // default - handles majority of carts
 {
-	loadRange(0x5000, 0x6FFF);
-	loadRange(0xD000, 0xDFFF);
-	loadRange(0xF000, 0xFFFF);
+	loadRange(m, 0x5000, 0x6FFF);
+	loadRange(m, 0xD000, 0xDFFF);
+	loadRange(m, 0xF000, 0xFFFF);
 }
 
-void load1()
+void load1(intv_machine *m)
 {
-	loadRange(0x5000, 0x6FFF);
-	loadRange(0xD000, 0xFFFF);
+	loadRange(m, 0x5000, 0x6FFF);
+	loadRange(m, 0xD000, 0xFFFF);
 }
 
-void load2()
+void load2(intv_machine *m)
 {
-	loadRange(0x5000, 0x6FFF);
-	loadRange(0x9000, 0xBFFF);
-	loadRange(0xD000, 0xDFFF);
+	loadRange(m, 0x5000, 0x6FFF);
+	loadRange(m, 0x9000, 0xBFFF);
+	loadRange(m, 0xD000, 0xDFFF);
 }
 
-void load3()
+void load3(intv_machine *m)
 {
-	loadRange(0x5000, 0x6FFF);
-	loadRange(0x9000, 0xAFFF);
-	loadRange(0xD000, 0xDFFF);
-	loadRange(0xF000, 0xFFFF);
+	loadRange(m, 0x5000, 0x6FFF);
+	loadRange(m, 0x9000, 0xAFFF);
+	loadRange(m, 0xD000, 0xDFFF);
+	loadRange(m, 0xF000, 0xFFFF);
 }
 
-void load4()
+void load4(intv_machine *m)
 {
-	loadRange(0x5000, 0x6FFF);
-	d000_ram = 1; /* $D000-$D3FF = RAM 8 */
+	loadRange(m, 0x5000, 0x6FFF);
+	m->d000_ram = 1; /* $D000-$D3FF = RAM 8 */
+	MemoryMapRAM8(m, 0xD000, 0xD3FF);
 }
 
-void load5()
+void load5(intv_machine *m)
 {
-	loadRange(0x5000, 0x7FFF);
-	loadRange(0x9000, 0xBFFF);
+	loadRange(m, 0x5000, 0x7FFF);
+	loadRange(m, 0x9000, 0xBFFF);
 }
 
-void load6()
+void load6(intv_machine *m)
 {
-	loadRange(0x6000, 0x7FFF);
+	loadRange(m, 0x6000, 0x7FFF);
 }
 
-void load7()
+void load7(intv_machine *m)
 {
-	loadRange(0x4800, 0x67FF);
+	loadRange(m, 0x4800, 0x67FF);
 }
 
-void load8()
+void load8(intv_machine *m)
 {
-	loadRange(0x5000, 0x5FFF);
-	loadRange(0x7000, 0x7FFF);
+	loadRange(m, 0x5000, 0x5FFF);
+	loadRange(m, 0x7000, 0x7FFF);
 }
 
-void load9()
+void load9(intv_machine *m)
 {
-	loadRange(0x5000, 0x6FFF);
-	loadRange(0x9000, 0xAFFF);
-	loadRange(0xD000, 0xDFFF);
-	loadRange(0xF000, 0xFFFF);
+	loadRange(m, 0x5000, 0x6FFF);
+	loadRange(m, 0x9000, 0xAFFF);
+	loadRange(m, 0xD000, 0xDFFF);
+	loadRange(m, 0xF000, 0xFFFF);
 	// [memattr] $8800 - $8FFF = RAM 8 // is this automatic too??? 
 }
 
@@ -465,14 +463,14 @@ int fingerprints[] =
 11566, 0  // Zaxxon (1982) (Coleco)
 };
 
-int getLoadMethod() // lazy, but it works
+int getLoadMethod(intv_machine *m) // lazy, but it works
 {
 	int i;
 	int fingerprint = 0;
 	// find fingerprint
 	for(i=0; i<256; i++)
 	{
-		fingerprint = fingerprint + data[i];
+		fingerprint = fingerprint + m->cart_data[i];
 	}
 	printf("[INFO] [FREEINTV] Cartridge fingerprint code: %i\n", fingerprint);
 	
@@ -485,7 +483,7 @@ int getLoadMethod() // lazy, but it works
 			if(fingerprint==11349)
 			{
 				// Baseball or MTE Test Cart?
-				if(size>8192) { return 8; } // load method 8 for MTE Test Cart
+				if(m->cart_size>8192) { return 8; } // load method 8 for MTE Test Cart
 				return 0; // default method for BaseBall
 			}
 			return fingerprints[i+1];
@@ -18,6 +18,8 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
-int LoadCart(const char *path);
+#include "intv.h"
+
+int LoadCart(intv_machine *m, const char *path);
 
 #endif
\ No newline at end of file
@@ -17,6 +17,7 @@
 */
 #include <math.h>
 #include "controller.h"
+#include "machine.h"
 #include "memory.h"
 
 const double PI = 3.14159265358979323846;
@@ -78,10 +79,11 @@ void controllerInit()
 	// swap the left and right controllers
 }
 
-void setControllerInput(int player, int state)
+void setControllerInput(intv_machine *m, int player, int state)
 {
 	int byte_val = (state^0xFF) & 0xFF;
-	Memory[(player^controllerSwap) + 0x1FE] = byte_val;
+	m->Memory[(player^controllerSwap) + 0x1FE] = byte_val;
+	MemoryMarkDirty(m, 0x1FE);
 	// Note: Debug logging would go here if needed
 	// The value written is state XORed with 0xFF, then masked to 0xFF
 	// For K_9 (0x24): written value = (0x24 ^ 0xFF) & 0xFF = 0xDB
@@ -18,6 +18,8 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include "intv.h"
+
 extern int controllerSwap;
 
 extern int keypadStates[];
@@ -42,7 +44,7 @@ int getControllerState(int joypad[], int player);
 
 int getKeypadState(int player, int joypad[], int joypre[]);
 
-void setControllerInput(int player, int state); 
+void setControllerInput(intv_machine *m, int player, int state); 
 
 void drawMiniKeypad(int player, unsigned int frame[]);
 
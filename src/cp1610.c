@@ -18,85 +18,136 @@
 #include <stdio.h>
 #include <string.h>
 #include "intv.h"
+#include "machine.h"
 #include "memory.h"
 #include "cp1610.h"
+#include "cp1610_jit.h"
+#include "profile.h"
+#include "trace.h"
+
+#include <retro_inline.h>
 
 // http://wiki.intellivision.us/index.php?title=CP1610#Instruction_Set
 // http://spatula-city.org/~im14u2c/chips/GICP1600.pdf
 // ftp://bitsavers.informatik.uni-stuttgart.de/components/gi/CP1600/CP-1600_Microprocessor_Users_Manual_May75.pdf
 
-int (*OpCodes[0x400])(int);
+int (*OpCodes[0x400])(intv_machine *, int);
 int Interuptable[0x400];
 const char *Nmemonic[0x400];
 
-unsigned int R[8] = {0, 0, 0, 0, 0, 0, 0x02F1, 0x1000}; // Registers R0-R7
-
 const int PC = 7; // const Program Counter (R7)
 const int SP = 6; // const Stack Pointer (R6)
 
-int InstructionRegister = 0; // four external lines?
+// Condition flags are stored raw, see FlagSZ in machine.h
+int FlagSign(intv_machine *m) { return (m->FlagSZ & 0x18000)!=0; }
+int FlagZero(intv_machine *m) { return (m->FlagSZ & 0xFFFF)==0; }
+int FlagCarry(intv_machine *m) { return (m->FlagC >> 16) & 1; }
+int FlagOverflow(intv_machine *m) { return (m->FlagO >> 15) & 1; }
+
+void SetFlagsSZOC(intv_machine *m, int s, int z, int o, int c) // set flags from bits
+{
+	m->FlagSZ = (s<<16) | !z;
+	m->FlagO = o<<15;
+	m->FlagC = c<<16;
+}
+
+// Predecoded instruction cache //
+// Opcode fetch and decode results are kept per address so that straight-line
+// ROM code is only read through readMem once.  Addresses where a read has
+// side effects (STIC, Intellivoice) or where the system writes Memory
+// directly (8-bit scratch RAM, PSG and controllers) are never cached.
+// writeMem calls CP1610Invalidate for every word it stores.
+// The entries live in the machine (Decoded, Current).
+
+void CP1610Serialize(intv_machine *m, struct CP1610serialized *all)
+{
+    all->Flag_DoubleByteData = m->Flag_DoubleByteData;
+    all->Flag_InteruptEnable = m->Flag_InteruptEnable;
+    all->Flag_Carry = FlagCarry(m);
+    all->Flag_Sign = FlagSign(m);
+    all->Flag_Zero = FlagZero(m);
+    all->Flag_Overflow = FlagOverflow(m);
+    memcpy(&all->R[0], &m->R[0], sizeof(m->R));
+}
+
+void CP1610Unserialize(intv_machine *m, const struct CP1610serialized *all)
+{
+    m->Flag_DoubleByteData = all->Flag_DoubleByteData;
+    m->Flag_InteruptEnable = all->Flag_InteruptEnable;
+    SetFlagsSZOC(m, all->Flag_Sign, all->Flag_Zero, all->Flag_Overflow, all->Flag_Carry);
+    memcpy(&m->R[0], &all->R[0], sizeof(m->R));
+}
 
-int Flag_DoubleByteData = 0;
-int Flag_InteruptEnable = 0;
-int Flag_Carry = 0;
-int Flag_Sign = 0;
-int Flag_Zero = 0;
-int Flag_Overflow = 0;
+void CP1610Reset(intv_machine *m)
+{
+	m->Flag_DoubleByteData = 0;
+	m->Flag_InteruptEnable = 0;
+	SetFlagsSZOC(m, 0, 0, 0, 0);
+	m->R[0] = m->R[1] = m->R[2] = m->R[3] = m->R[4] = m->R[5] = 0;
+	m->R[SP] = 0x02F1; // Stack is at System Ram 0x02F1-0x0318
+	m->R[PC] = 0x1000; // EXEC entry point
+	CP1610FlushCache(m);
+}
 
-void CP1610Serialize(struct CP1610serialized *all)
+int isCacheable(int adr)
 {
-    all->Flag_DoubleByteData = Flag_DoubleByteData;
-    all->Flag_InteruptEnable = Flag_InteruptEnable;
-    all->Flag_Carry = Flag_Carry;
-    all->Flag_Sign = Flag_Sign;
-    all->Flag_Zero = Flag_Zero;
-    all->Flag_Overflow = Flag_Overflow;
-    memcpy(&all->R[0], &R[0], sizeof(R));
+	adr &= 0xFFFF;
+	if(adr<0x200) { return 0; } // STIC, Intellivoice, 8-bit scratch, PSG, controllers
+	if((adr & 0x3fc0) == 0x0000) { return 0; } // STIC aliases
+	return 1;
 }
 
-void CP1610Unserialize(const struct CP1610serialized *all)
+void CP1610FlushCache(intv_machine *m)
 {
-    Flag_DoubleByteData = all->Flag_DoubleByteData;
-    Flag_InteruptEnable = all->Flag_InteruptEnable;
-    Flag_Carry = all->Flag_Carry;
-    Flag_Sign = all->Flag_Sign;
-    Flag_Zero = all->Flag_Zero;
-    Flag_Overflow = all->Flag_Overflow;
-    memcpy(&R[0], &all->R[0], sizeof(R));
+	memset(m->Decoded, 0, sizeof(m->Decoded));
+	CP1610JitFlush(m);
 }
 
-void CP1610Reset()
+void CP1610SetCache(intv_machine *m, int mode)
 {
-	Flag_DoubleByteData = 0;
-	Flag_InteruptEnable = 0;
-	Flag_Carry = 0;
-	Flag_Sign = 0;
-	Flag_Zero = 0;
-	Flag_Overflow = 0;
-	R[0] = R[1] = R[2] = R[3] = R[4] = R[5] = 0;
-	R[SP] = 0x02F1; // Stack is at System Ram 0x02F1-0x0318
-	R[PC] = 0x1000; // EXEC entry point
+	if(mode != m->CacheEnabled)
+	{
+		m->CacheEnabled = mode;
+		CP1610JitFree(m);
+		if(mode == 2)
+		{
+			m->Jit = CP1610JitCreate(); // stays NULL where there is no compiler
+		}
+		CP1610FlushCache(m);
+	}
 }
 
-int readIndirect(int reg) // Read Indirect, handle SDBD, update autoincriment registers
+void CP1610Invalidate(intv_machine *m, int adr)
+{
+	// an entry covers the opcode and up to two operand words
+	m->Decoded[adr & 0xFFFF].op = NULL;
+	m->Decoded[(adr-1) & 0xFFFF].op = NULL;
+	m->Decoded[(adr-2) & 0xFFFF].op = NULL;
+	if(m->Jit != NULL)
+	{
+		CP1610JitInvalidate(m, adr);
+	}
+}
+
+int readIndirect(intv_machine *m, int reg) // Read Indirect, handle SDBD, update autoincriment registers
 {
     int val = 0;
     int adr = 0;
     
-    if(reg==6) { R[reg] = R[reg] - 1; } // decriment R6 (SP) before read
-    adr = R[reg];
+    if(reg==6) { m->R[reg] = m->R[reg] - 1; } // decriment R6 (SP) before read
+    adr = m->R[reg];
     
-    val = readMem(adr);
+    val = readMem(m, adr);
     if(reg==4 || reg==5 || reg==7) // autoincrement registers R4-R7 excluding SP (R6)
     {
-        R[reg] = (R[reg]+1) & 0xFFFF;
+        m->R[reg] = (m->R[reg]+1) & 0xFFFF;
     }
-    if(Flag_DoubleByteData == 1) {
+    if(m->Flag_DoubleByteData == 1) {
         val &= 0xff;
         if(reg==4 || reg==5 || reg==7) // autoincrement registers (incremented twice for double byte data)
         {
-            val |= ((readMem(adr+1) & 0xFF)<<8);
-            R[reg] = (R[reg]+1) & 0xFFFF;
+            val |= ((readMem(m, adr+1) & 0xFF)<<8);
+            m->R[reg] = (m->R[reg]+1) & 0xFFFF;
         } else {
             val |= val << 8;
         }
@@ -104,277 +155,276 @@ int readIndirect(int reg) // Read Indirect, handle SDBD, update autoincriment re
     return val;
 }
 
-void writeIndirect(int reg, int val)
+void writeIndirect(intv_machine *m, int reg, int val)
 {
-	int adr = R[reg];
-	writeMem(adr, val);
+	int adr = m->R[reg];
+	writeMem(m, adr, val);
 	if(reg>=4) // autoincrement registers R4-R7
 	{
-		R[reg] = (R[reg]+1) & 0xFFFF;
+		m->R[reg] = (m->R[reg]+1) & 0xFFFF;
 	}
 }
 
-int readOperand(void)
+int readOperand(intv_machine *m)
 {
-	int val = readMem(R[PC]);
-	R[PC]++;
+	int val = (m->Current != NULL) ? m->Current->operand : readMem(m, m->R[PC]);
+	m->R[PC]++;
 	return val;
 }
 
-int readOperandIndirect(void)
+int readOperandIndirect(intv_machine *m)
 {
-	int adr = readMem(R[PC]);
-	int val = readMem(adr);
-	R[PC]++;
+	int adr = (m->Current != NULL) ? m->Current->operand : readMem(m, m->R[PC]);
+	int val = readMem(m, adr);
+	m->R[PC]++;
 	return val;
 }
 
-void SetFlagsSZ(int reg)
+void SetFlagsSZ(intv_machine *m, int reg)
+{
+	m->R[reg] = m->R[reg] & 0xFFFF;
+	m->FlagSZ = m->R[reg];
+}
+
+void SetFlagsSZ8(intv_machine *m, int reg) // sign from bit 7: SWAP and the right shifts
 {
-	R[reg] = R[reg] & 0xFFFF;
-	Flag_Sign = (R[reg] & 0x8000)!=0;
-	Flag_Zero = R[reg]==0;
+	m->FlagSZ = (((m->R[reg]>>7) & 1)<<16) | (m->R[reg]!=0);
 }
 
-int AddSetSZOC(int A, int B)
+int AddSetSZOC(intv_machine *m, int A, int B)
 {
-	int signa = A & 0x8000;
-	int signb = B & 0x8000;
 	int result = (A+B);
-	int signr =  result & 0x8000;
 
-	Flag_Overflow = (signa==signb && signa!=signr) ? 1 : 0;
-	Flag_Carry = (result & 0x10000) != 0;
+	m->FlagO = ~(A ^ B) & (A ^ result); // operand signs equal, result sign different
+	m->FlagC = result;
 
 	result = result & 0xFFFF;
 
-	Flag_Sign = (result & 0x8000)!=0;
-	Flag_Zero = result==0;
+	m->FlagSZ = result;
 	return result;
 }
-int SubSetOC(int A, int B)
+int SubSetOC(intv_machine *m, int A, int B)
 {
-	int signa = A & 0x8000;
-	int signb = B & 0x8000;
 	int result = (A + (B ^ 0xFFFF) + 1); // A - B using 1's compliment;
-	int signr =  result & 0x8000;
-	Flag_Carry = (result & 0x10000)!=0;
-	Flag_Overflow = (signa!=signb && signa!=signr) ? 1 : 0;
+	m->FlagC = result;
+	m->FlagO = (A ^ B) & (A ^ result); // operand signs differ, result sign different
 	return result & 0xFFFF;
 }
 
-int CP1610Tick(int debug)
+const struct decoded *decode(intv_machine *m, int adr);
+
+int CP1610Interrupt(intv_machine *m)
+{
+	// Take VBlank Interupt //
+	m->SR1 = 0;
+	writeIndirect(m, SP, m->R[PC]); // push PC...
+	m->R[PC] = 0x1004; // Jump
+	return 12;
+}
+
+// The debug tick (profiler, trace) is a separate copy, so it costs nothing when off
+static INLINE int Tick(intv_machine *m, const int debug)
 {
 	// execute one instruction //
-	int sdbd = Flag_DoubleByteData;
+	int sdbd = m->Flag_DoubleByteData;
+	int pc = m->R[PC];
 
-	unsigned int instruction = readMem(R[PC]);
+	const struct decoded *cached = &m->Decoded[m->R[PC] & 0xFFFF];
+	unsigned int instruction;
+	int (*op)(intv_machine *, int);
 
 	int ticks = 0;
-#if 0
-    static int global_ticks = 0;
-#endif
 
-    // DEBUG
-#if 0
-    {
-        FILE *debug_file;
-        
-        fprintf(stdout, "%04x:[%03x%c %04x %04x %04x %04x %04x %04x %04x %s %c%c%c%c%c%c\n", R[7], instruction, instruction > 0x03ff ? 'X' : ']', R[0], R[1], R[2], R[3], R[4], R[5], R[6], Nmemonic[instruction], Flag_Sign ? 'S' : '-', Flag_Carry ? 'C' : '-', Flag_Overflow ? 'O' : '-', Flag_Zero ? 'Z' : '-', Flag_InteruptEnable ? 'I' : '-', Flag_DoubleByteData ? 'D' : '-');
-    }
-#endif
-#if 0   // Debug output compatible with JZINTV for comparison purposes
-    {
-        FILE *debug_file;
-        
-        fprintf(debug_file, " %04X %04X %04X %04X %04X %04X %04X %04X %c%c%c%c%c%c%c%c %20s %d\n", R[0], R[1], R[2], R[3], R[4], R[5], R[6], R[7],
-            Flag_Sign ? 'S' : '-',
-            Flag_Zero ? 'Z' : '-',
-            Flag_Overflow ? 'O' : '-',
-            Flag_Carry ? 'C' : '-',
-            Flag_InteruptEnable ? 'I' : '-',
-            Flag_DoubleByteData ? 'D' : '-',
-            Interuptable[instruction] ? 'i' : '-',
-            SR1 > 0 ? 'q' : '-' , Nmemonic[instruction], global_ticks);
-    }
-#endif
-    
+	if(cached->op == NULL)
+	{
+		cached = m->CacheEnabled ? decode(m, m->R[PC]) : NULL;
+	}
+	if(cached != NULL)
+	{
+		instruction = cached->instruction;
+		op = cached->op;
+	}
+	else
+	{
+		instruction = readMem(m, m->R[PC]);
+		op = OpCodes[instruction & 0x3FF];
+	}
+	if(debug && TraceEnabled) { TraceBegin(m, instruction); }
+
     if(instruction > 0x03FF)
 	{
 		printf("[ERROR][FREEINT] Bad opcode: %i\n", instruction);
 	        // bad OpCode, Halt //
+		if(debug && TraceEnabled) { TraceEnd(0); }
 		return 0;
 	}
 
-	R[PC]++; // point PC/R7 at operand/next address
+	m->R[PC]++; // point PC/R7 at operand/next address
     
-	ticks = OpCodes[instruction](instruction); // execute instruction
+	m->Current = cached;
+	ticks = op(m, instruction); // execute instruction
+	m->Current = NULL;
+
+	if(sdbd==1) { m->Flag_DoubleByteData = 0; } // reset SDBD
 
-	if(sdbd==1) { Flag_DoubleByteData = 0; } // reset SDBD
+	if(debug && ProfileEnabled) { ProfileHit(pc, instruction, ticks); }
 
 	// check interupt request
-	if(Flag_InteruptEnable == 1 && SR1>0)
+	if(m->Flag_InteruptEnable == 1 && m->SR1>0)
 	{
 		if(Interuptable[instruction])
 		{
-			// Take VBlank Interupt //
-			SR1 = 0;
-			writeIndirect(SP, R[PC]); // push PC...
-			R[PC] = 0x1004; // Jump
-            ticks += 12;
+			ticks += CP1610Interrupt(m);
 		}
 	}
 
-#if 0
-    global_ticks += ticks;
-#endif
+	if(debug && TraceEnabled) { TraceEnd(ticks); }
 	return ticks;
 }
 
-int HLT(int v)
+int CP1610Tick(intv_machine *m, int debug) { return Tick(m, 0); }
+
+int CP1610TickDebug(intv_machine *m, int debug) { return Tick(m, 1); }
+
+int HLT(intv_machine *m, int v)
 {
     // Halt Instruction found! //
     printf("\n\n[ERROR] [FREEINTV] HALT!\n");
   
-    R[PC]--; // Repeat instruction forever instead of exiting without warning
+    m->R[PC]--; // Repeat instruction forever instead of exiting without warning
     return 0;
 }
 
-int SDBD(int v) { Flag_DoubleByteData = 1; return 4; } // Set Double Byte Data
-int EIS(int v)  { Flag_InteruptEnable = 1; return 4; } // Enable Interrupt System
-int DIS(int v)  { Flag_InteruptEnable = 0; return 4; } // Disable Interrupt System
-int Jump(int v)
+int SDBD(intv_machine *m, int v) { m->Flag_DoubleByteData = 1; return 4; } // Set Double Byte Data
+int EIS(intv_machine *m, int v)  { m->Flag_InteruptEnable = 1; return 4; } // Enable Interrupt System
+int DIS(intv_machine *m, int v)  { m->Flag_InteruptEnable = 0; return 4; } // Disable Interrupt System
+int Jump(intv_machine *m, int v)
 { 
 	// J, JE, JD, JSR, JSRE, JSRD, CALL
 	// 0000:0000:0000:0100  0000:00rr:aaaa:aaff  0000:00aa:aaaa:aaaa
-	int decle2 = readOperand();
-	int decle3 = readOperand() & 0x3FF;
+	int decle2 = readOperand(m);
+	int decle3 = readOperand(m) & 0x3FF;
 	int reg = (decle2>>8) & 0x03; // 0-R4, 1-R5, 2-R6, 3-don't store return address
 	int adr = (((decle2>>2) & 0x3F)<<10) | decle3;
 	int ff = decle2 & 0x03; // Interrupt flag (0-no change, 1-set, 2-clear, 3-undefined)
 	if(reg!=3)
 	{
 		reg = reg + 4;
-		R[reg] = R[PC]; // store return address (PC already advanced to PC+3)
+		m->R[reg] = m->R[PC]; // store return address (PC already advanced to PC+3)
 	}
-	if(ff==1) { Flag_InteruptEnable = 1; } // set Interupt flag
-	if(ff==2) { Flag_InteruptEnable = 0; } // clear Interrupt flag
-	R[PC] = adr; // Jump
+	if(ff==1) { m->Flag_InteruptEnable = 1; } // set Interupt flag
+	if(ff==2) { m->Flag_InteruptEnable = 0; } // clear Interrupt flag
+	m->R[PC] = adr; // Jump
 	return 13;
 }
-int TCI(int v)  { return 4; } // Terminate Current Interrupt (not used)
-int CLRC(int v) { Flag_Carry = 0; return 4; } // Clear Carry
-int SETC(int v) { Flag_Carry = 1; return 4; } // Set Carry
+int TCI(intv_machine *m, int v)  { return 4; } // Terminate Current Interrupt (not used)
+int CLRC(intv_machine *m, int v) { m->FlagC = 0; return 4; } // Clear Carry
+int SETC(intv_machine *m, int v) { m->FlagC = 0x10000; return 4; } // Set Carry
 
 #define EXTRA_IF_R6(reg)  (reg == 6 ? 3 : 0)
 #define EXTRA_IF_R6R7(reg)  (reg >= 6 ? 1 : 0)
 
-int INCR(int v) // Increment Register
+int INCR(intv_machine *m, int v) // Increment Register
 {
 	int reg = v & 0x07;
-	R[reg] = R[reg]+1;
-	SetFlagsSZ(reg);
+	m->R[reg] = m->R[reg]+1;
+	SetFlagsSZ(m, reg);
     return 6 + EXTRA_IF_R6R7(reg);
 }
-int DECR(int v) // Decrement Register
+int DECR(intv_machine *m, int v) // Decrement Register
 {
 	int reg = v & 0x07;
-	R[reg] = R[reg]-1;
-	SetFlagsSZ(reg);
+	m->R[reg] = m->R[reg]-1;
+	SetFlagsSZ(m, reg);
     return 6 + EXTRA_IF_R6R7(reg);
 }
-int COMR(int v) // Complement Register (One's Compliment)
+int COMR(intv_machine *m, int v) // Complement Register (One's Compliment)
 {
 	int reg = v & 0x07;
-	R[reg] = R[reg] ^ 0xFFFF;
-	SetFlagsSZ(reg);
+	m->R[reg] = m->R[reg] ^ 0xFFFF;
+	SetFlagsSZ(m, reg);
     return 6 + EXTRA_IF_R6R7(reg);
 }
-int NEGR(int v) // Negate Register (Two's Compliment)
+int NEGR(intv_machine *m, int v) // Negate Register (Two's Compliment)
 {
 	int reg = v & 0x07;
-	R[reg] = SubSetOC(0, R[reg]);
-    SetFlagsSZ(reg);
+	m->R[reg] = SubSetOC(m, 0, m->R[reg]);
+    SetFlagsSZ(m, reg);
     return 6 + EXTRA_IF_R6R7(reg);
 }
-int ADCR(int v) // Add Carry to Register
+int ADCR(intv_machine *m, int v) // Add Carry to Register
 {
 	int reg = v & 0x07;
-	R[reg] = AddSetSZOC(R[reg], Flag_Carry);
+	m->R[reg] = AddSetSZOC(m, m->R[reg], FlagCarry(m));
     return 6 + EXTRA_IF_R6R7(reg);
 }
-int GSWD(int v) // Get the Status Word szoc:0000:szoc:0000
+int GSWD(intv_machine *m, int v) // Get the Status Word szoc:0000:szoc:0000
 {
 	int reg = v & 0x03;
-	unsigned int szoc = (Flag_Sign<<3) | (Flag_Zero<<2) | (Flag_Overflow<<1) | Flag_Carry;
-	R[reg] = (szoc<<12) | (szoc<<4);
+	unsigned int szoc = (FlagSign(m)<<3) | (FlagZero(m)<<2) | (FlagOverflow(m)<<1) | FlagCarry(m);
+	m->R[reg] = (szoc<<12) | (szoc<<4);
 	return 6;
 }
-int NOP(int v) { return 6; } // No Operation
-int SIN(int v) { return 6; } // Software Interrupt (not used)
+int NOP(intv_machine *m, int v) { return 6; } // No Operation
+int SIN(intv_machine *m, int v) { return 6; } // Software Interrupt (not used)
 
-int RSWD(int v) // Return Status Word szoc:0000
+int RSWD(intv_machine *m, int v) // Return Status Word szoc:0000
 {
 	int reg = v & 0x07;
-	unsigned int szoc = R[reg]>>4;
-	Flag_Sign = (szoc>>3) & 1;
-	Flag_Zero = (szoc>>2) & 1;
-	Flag_Overflow = (szoc>>1) & 1;
-	Flag_Carry = szoc & 1;
+	unsigned int szoc = m->R[reg]>>4;
+	SetFlagsSZOC(m, (szoc>>3) & 1, (szoc>>2) & 1, (szoc>>1) & 1, szoc & 1);
 	return 6;
 }
-int SWAP(int v) // Swap 0000:0trr
+int SWAP(intv_machine *m, int v) // Swap 0000:0trr
 {
 	int reg = v & 0x03;
 	int times = (v>>2) & 1;
-	int upper = (R[reg]>>8) & 0xFF;
-	int lower = R[reg] & 0xFF;
+	int upper = (m->R[reg]>>8) & 0xFF;
+	int lower = m->R[reg] & 0xFF;
 	if(times==0) // single swap
 	{
-		R[reg] = (lower<<8) | upper;
-		Flag_Sign = (R[reg]>>7) & 1;
-		Flag_Zero = R[reg]==0;
+		m->R[reg] = (lower<<8) | upper;
+		SetFlagsSZ8(m, reg);
 		return 6;
 	}
 	else // double swap
 	{
-		R[reg] = (lower<<8) | lower;
-		Flag_Sign = (R[reg]>>7) & 1;
-		Flag_Zero = R[reg]==0;
+		m->R[reg] = (lower<<8) | lower;
+		SetFlagsSZ8(m, reg);
 		return 8;
 	}
 }
-int SLL(int v) // Shift Logical Left 0000:1drr
+int SLL(intv_machine *m, int v) // Shift Logical Left 0000:1drr
 {
 	int reg = v & 0x03;
 	int dist = ((v>>2) & 1)+1;
-	R[reg] = R[reg]<<dist;
-	SetFlagsSZ(reg);
+	m->R[reg] = m->R[reg]<<dist;
+	SetFlagsSZ(m, reg);
 	return 6+(2*(dist-1)); // 6 <<1 or 8 <<2
 }
-int RLC(int v) // Rotate Left Through Carry
+int RLC(intv_machine *m, int v) // Rotate Left Through Carry
 {
 	int reg = v & 0x03;
 	int times = ((v>>2) & 1);
-	int bit15 = (R[reg]>>15) & 1;
-	int bit14 = (R[reg]>>14) & 1;
+	int bit15 = (m->R[reg]>>15) & 1;
+	int bit14 = (m->R[reg]>>14) & 1;
 	if(times==0) // Single rotate
 	{
-		R[reg] = R[reg] << 1;
-		R[reg] = R[reg] | Flag_Carry;
-		Flag_Carry = bit15;
+		m->R[reg] = m->R[reg] << 1;
+		m->R[reg] = m->R[reg] | FlagCarry(m);
+		m->FlagC = bit15<<16;
 	}
 	else // Double rotate
 	{
-		R[reg] = R[reg] << 2;
-		R[reg] = R[reg] | ((Flag_Carry << 1) | Flag_Overflow);
-		Flag_Carry = bit15;
-		Flag_Overflow = bit14;
+		m->R[reg] = m->R[reg] << 2;
+		m->R[reg] = m->R[reg] | ((FlagCarry(m) << 1) | FlagOverflow(m));
+		m->FlagC = bit15<<16;
+		m->FlagO = bit14<<15;
 	}
-	SetFlagsSZ(reg);
+	SetFlagsSZ(m, reg);
 	return 6+(2*times); // 6 single or 8 double
 }
-int SLLC(int v) // Shift Logical Left through Carry
+int SLLC(intv_machine *m, int v) // Shift Logical Left through Carry
 {
 	// CP-1600 Manual says to use O as bit 16 and C as bit 17
 	// on a double shift, and C as bit 16 on a single shift.
@@ -383,144 +433,139 @@ int SLLC(int v) // Shift Logical Left through Carry
 	// The wiki method seems to be correct
 	int reg = v & 0x03;
 	int dist = ((v>>2) & 1)+1;
-	int bit15 = (R[reg]>>15) & 1;
-	int bit14 = (R[reg]>>14) & 1;
-	R[reg] = (R[reg]<<dist);
-	Flag_Carry = bit15;			
+	int bit15 = (m->R[reg]>>15) & 1;
+	int bit14 = (m->R[reg]>>14) & 1;
+	m->R[reg] = (m->R[reg]<<dist);
+	m->FlagC = bit15<<16;
 	if(dist==2)
 	{
-		Flag_Overflow = bit14; // wiki.intellivision.us method 
+		m->FlagO = bit14<<15; // wiki.intellivision.us method 
 		//Flag_Carry = bit14; // CP-1600 Manual method
 		//Flag_Overflow = bit15; // CP-1600 Manual method
 	}
-	SetFlagsSZ(reg);
+	SetFlagsSZ(m, reg);
 	return 6+(2*(dist-1)); // 6 <<1 or 8 <<2
 }
-int SLR(int v) // Shift Logical Right
+int SLR(intv_machine *m, int v) // Shift Logical Right
 {
 	int reg = v & 0x03;
 	int dist = ((v>>2) & 1)+1;
-	R[reg] = R[reg]>>dist;
-	Flag_Sign = (R[reg]>>7) & 1;
-	Flag_Zero = R[reg]==0;
+	m->R[reg] = m->R[reg]>>dist;
+	SetFlagsSZ8(m, reg);
 	return 6+(2*(dist-1)); // 6 <<1 or 8 <<2
 }
-int SAR(int v) // Shift Arithmetic Right
+int SAR(intv_machine *m, int v) // Shift Arithmetic Right
 {
 	int reg = v & 0x03;
 	int dist = ((v>>2) & 1)+1;
-	int bit15 = (R[reg]>>15) & 1;
+	int bit15 = (m->R[reg]>>15) & 1;
 
-	R[reg] = R[reg]>>dist;
+	m->R[reg] = m->R[reg]>>dist;
 	if(dist==1)
 	{
-		R[reg] = R[reg] | (bit15<<15);
+		m->R[reg] = m->R[reg] | (bit15<<15);
 	}
 	else
 	{
-		R[reg] = R[reg] | (bit15<<15);
-		R[reg] = R[reg] | (bit15<<14); // CP-1600 manual says "sign bit copied to high bits"
+		m->R[reg] = m->R[reg] | (bit15<<15);
+		m->R[reg] = m->R[reg] | (bit15<<14); // CP-1600 manual says "sign bit copied to high bits"
 	}
-	Flag_Sign = (R[reg]>>7) & 1;
-	Flag_Zero = R[reg]==0;
+	SetFlagsSZ8(m, reg);
 	return 6+(2*(dist-1)); // 6 <<1 or 8 <<2
 }
-int RRC(int v) // Rotate Right Through Carry
+int RRC(intv_machine *m, int v) // Rotate Right Through Carry
 {
 	int reg = v & 0x03;
 	int dist = ((v>>2) & 1);
-	int bit1 = (R[reg]>>1) & 1;
-	int bit0 = R[reg] & 1;
+	int bit1 = (m->R[reg]>>1) & 1;
+	int bit0 = m->R[reg] & 1;
 
 	if(dist==0)
 	{
-		R[reg] = R[reg]>>1;
-		R[reg] = R[reg] | (Flag_Carry<<15);
+		m->R[reg] = m->R[reg]>>1;
+		m->R[reg] = m->R[reg] | (FlagCarry(m)<<15);
 	}
 	else
 	{
-		R[reg] = R[reg]>>2;
-		R[reg] = R[reg] | (Flag_Overflow<<15);
-		R[reg] = R[reg] | (Flag_Carry<<14);
-		Flag_Overflow = bit1;
+		m->R[reg] = m->R[reg]>>2;
+		m->R[reg] = m->R[reg] | (FlagOverflow(m)<<15);
+		m->R[reg] = m->R[reg] | (FlagCarry(m)<<14);
+		m->FlagO = bit1<<15;
 	}
-	Flag_Carry = bit0;
-	Flag_Sign = (R[reg]>>7) & 1;
-	Flag_Zero = R[reg]==0;
+	m->FlagC = bit0<<16;
+	SetFlagsSZ8(m, reg);
 	return 6+(2*(dist)); // 6 <<1 or 8 <<2
 }
-int SARC(int v) // Shift Arithmetic Right Through Carry 
+int SARC(intv_machine *m, int v) // Shift Arithmetic Right Through Carry 
 {
 	int reg = v & 0x03;
 	int dist = ((v>>2) & 1)+1;
-	int bit15 = (R[reg]>>15) & 1;
-	int bit1 = (R[reg]>>1) & 1;
-	int bit0 = R[reg] & 1;
+	int bit15 = (m->R[reg]>>15) & 1;
+	int bit1 = (m->R[reg]>>1) & 1;
+	int bit0 = m->R[reg] & 1;
 
-	R[reg] = R[reg]>>dist;
-	R[reg] = R[reg] | (bit15<<15);
+	m->R[reg] = m->R[reg]>>dist;
+	m->R[reg] = m->R[reg] | (bit15<<15);
 	if(dist==2)
 	{
-		R[reg] = R[reg] | (bit15<<14); // CP-1600 manual says "sign bit copied to high 2 bits"
-		Flag_Overflow = bit1;
+		m->R[reg] = m->R[reg] | (bit15<<14); // CP-1600 manual says "sign bit copied to high 2 bits"
+		m->FlagO = bit1<<15;
 	}
-	Flag_Carry = bit0;
-	Flag_Sign = (R[reg]>>7) & 1;
-	Flag_Zero = R[reg]==0;
+	m->FlagC = bit0<<16;
+	SetFlagsSZ8(m, reg);
 	return 6+(2*(dist-1)); // 6 <<1 or 8 <<2
 }
-int MOVR(int v) // Move Register
+int MOVR(intv_machine *m, int v) // Move Register
 {
 	int sreg = (v >> 3) & 0x7;
 	int dreg = v & 0x7;
-	R[dreg] = R[sreg];
-	SetFlagsSZ(dreg);
+	m->R[dreg] = m->R[sreg];
+	SetFlagsSZ(m, dreg);
     return 6 + EXTRA_IF_R6R7(dreg);
 }
-int ADDR(int v) // Add Registers
+int ADDR(intv_machine *m, int v) // Add Registers
 {
 	int sreg = (v >> 3) & 0x7;
 	int dreg = v & 0x7;
-	R[dreg] = AddSetSZOC(R[dreg], R[sreg]);
+	m->R[dreg] = AddSetSZOC(m, m->R[dreg], m->R[sreg]);
     return 6 + EXTRA_IF_R6R7(dreg);
 }
-int SUBR(int v) // Subtract Registers
+int SUBR(intv_machine *m, int v) // Subtract Registers
 {
 	int sreg = (v >> 3) & 0x7;
 	int dreg = v & 0x7;
-	R[dreg] = SubSetOC(R[dreg], R[sreg]);
-	SetFlagsSZ(dreg);
+	m->R[dreg] = SubSetOC(m, m->R[dreg], m->R[sreg]);
+	SetFlagsSZ(m, dreg);
     return 6 + EXTRA_IF_R6R7(dreg);
 }
-int CMPR(int v) // Compare Registers
+int CMPR(intv_machine *m, int v) // Compare Registers
 {
 	int sreg = (v >> 3) & 0x7;
 	int dreg = v & 0x7;
-	int res = SubSetOC(R[dreg], R[sreg]);
-	Flag_Sign = (res & 0x8000)!=0;
-	Flag_Zero = res==0;
+	int res = SubSetOC(m, m->R[dreg], m->R[sreg]);
+	m->FlagSZ = res;
     return 6 + EXTRA_IF_R6R7(dreg);
 }
-int ANDR(int v) // And Registers
+int ANDR(intv_machine *m, int v) // And Registers
 {
 	int sreg = (v >> 3) & 0x7;
 	int dreg = v & 0x7;
-	R[dreg] = R[dreg] & R[sreg];
-	SetFlagsSZ(dreg);
+	m->R[dreg] = m->R[dreg] & m->R[sreg];
+	SetFlagsSZ(m, dreg);
     return 6 + EXTRA_IF_R6R7(dreg);
 }
-int XORR(int v) // Xor Registers
+int XORR(intv_machine *m, int v) // Xor Registers
 {
 	int sreg = (v >> 3) & 0x7;
 	int dreg = v & 0x7;
-	R[dreg] = R[dreg] ^ R[sreg];
-	SetFlagsSZ(dreg);
+	m->R[dreg] = m->R[dreg] ^ m->R[sreg];
+	SetFlagsSZ(m, dreg);
     return 6 + EXTRA_IF_R6R7(dreg);
 }
-int Branch(int v) // Branch - B, BC, BOV, BPL, BEQ, BLT, BLE, BUSC, NOPP, BNC, BNOV, BMI, BNEQ, BGE, BGT, BESC, BEXT
+int Branch(intv_machine *m, int v) // Branch - B, BC, BOV, BPL, BEQ, BLT, BLE, BUSC, NOPP, BNC, BNOV, BMI, BNEQ, BGE, BGT, BESC, BEXT
 {
 	//0000:0010:00de:nccc  aaaa:aaaa:aaaa:aaaa
-	int offset = readOperand();
+	int offset = readOperand(m);
 	int direction = (v >> 5) & 0x01;
 	int ext = (v >> 4) & 0x01;
 	int notbit = (v >> 3) & 0x01;
@@ -535,10 +580,10 @@ int Branch(int v) // Branch - B, BC, BOV, BPL, BEQ, BLT, BLE, BUSC, NOPP, BNC, B
 		// digital states to be sampled by the CPU during the execution of the BEXT
 		// (Branch on EXTernal) instruction
 		// --- I don't know what is meant by 'instruction register'
-		if((InstructionRegister & 0x0F)==(v & 0x0F))
+		if((m->InstructionRegister & 0x0F)==(v & 0x0F))
 		{
-			if(direction==0) { R[PC] = R[PC]+offset; }
-			if(direction==1) { R[PC] = R[PC]-offset-1; }
+			if(direction==0) { m->R[PC] = m->R[PC]+offset; }
+			if(direction==1) { m->R[PC] = m->R[PC]-offset-1; }
             return 9;
 		}
 		return 7;
@@ -546,179 +591,294 @@ int Branch(int v) // Branch - B, BC, BOV, BPL, BEQ, BLT, BLE, BUSC, NOPP, BNC, B
 	switch(condition)
 	{
 		case 0: branch = 1; break; // B, NOPP
-		case 1: branch = (Flag_Carry==1); break; // BC, BNC
-		case 2: branch = (Flag_Overflow==1); break; // BOV, BNOV
-		case 3: branch = (Flag_Sign==0); break; // BPL, BMI
-		case 4: branch = (Flag_Zero==1); break; // BEQ, BNEQ
-		case 5: branch = (Flag_Sign!=Flag_Overflow); break; // BLT, BGE
-		case 6: branch = (Flag_Zero==1)||(Flag_Sign!=Flag_Overflow); break; // BLE, BGT
-		case 7: branch = (Flag_Sign!=Flag_Carry); break; // BUSC, BESC
+		case 1: branch = (FlagCarry(m)==1); break; // BC, BNC
+		case 2: branch = (FlagOverflow(m)==1); break; // BOV, BNOV
+		case 3: branch = (FlagSign(m)==0); break; // BPL, BMI
+		case 4: branch = (FlagZero(m)==1); break; // BEQ, BNEQ
+		case 5: branch = (FlagSign(m)!=FlagOverflow(m)); break; // BLT, BGE
+		case 6: branch = (FlagZero(m)==1)||(FlagSign(m)!=FlagOverflow(m)); break; // BLE, BGT
+		case 7: branch = (FlagSign(m)!=FlagCarry(m)); break; // BUSC, BESC
 	}
 	if(notbit==1) { branch = !branch; }
 	if(branch)
 	{
-		if(direction==0) { R[PC] = R[PC]+offset; }
-		if(direction==1) { R[PC] = R[PC]-(offset+1); }
+		if(direction==0) { m->R[PC] = m->R[PC]+offset; }
+		if(direction==1) { m->R[PC] = m->R[PC]-(offset+1); }
+		return 9;
+	}
+	return 7;
+}
+int JumpCached(intv_machine *m, int v) // Jump with operands decoded by decode()
+{
+	int reg = m->Current->operand;
+	int ff = m->Current->flags;
+	m->R[PC] += 2;
+	if(reg!=0)
+	{
+		m->R[reg] = m->R[PC]; // store return address
+	}
+	if(ff==1) { m->Flag_InteruptEnable = 1; } // set Interupt flag
+	if(ff==2) { m->Flag_InteruptEnable = 0; } // clear Interrupt flag
+	m->R[PC] = m->Current->adr; // Jump
+	return 13;
+}
+int BranchCached(intv_machine *m, int v) // Branch with the offset word from the cache, BEXT is never cached
+{
+	int branch = 0;
+	m->R[PC]++;
+	switch(v & 0x07)
+	{
+		case 0: branch = 1; break; // B, NOPP
+		case 1: branch = (FlagCarry(m)==1); break; // BC, BNC
+		case 2: branch = (FlagOverflow(m)==1); break; // BOV, BNOV
+		case 3: branch = (FlagSign(m)==0); break; // BPL, BMI
+		case 4: branch = (FlagZero(m)==1); break; // BEQ, BNEQ
+		case 5: branch = (FlagSign(m)!=FlagOverflow(m)); break; // BLT, BGE
+		case 6: branch = (FlagZero(m)==1)||(FlagSign(m)!=FlagOverflow(m)); break; // BLE, BGT
+		case 7: branch = (FlagSign(m)!=FlagCarry(m)); break; // BUSC, BESC
+	}
+	if((v >> 3) & 0x01) { branch = !branch; }
+	if(branch)
+	{
+		if(((v >> 5) & 0x01)==0) { m->R[PC] = m->R[PC]+m->Current->operand; }
+		else { m->R[PC] = m->R[PC]-(m->Current->operand+1); }
 		return 9;
 	}
 	return 7;
 }
-int MVO(int v) // Move Out
+int MVO(intv_machine *m, int v) // Move Out
 {
 	int reg = v & 0x07;
-	int adr = readOperand();
-	writeMem(adr, R[reg]);
+	int adr = readOperand(m);
+	writeMem(m, adr, m->R[reg]);
 	return 11;
 }
-int MVOa(int v) // MVO@ - Move Out Indirect  0000:0010:01aa:asss
+int MVOa(intv_machine *m, int v) // MVO@ - Move Out Indirect  0000:0010:01aa:asss
 {
 	// The PSHR Rx instruction is an alias for MVOa Rx, R6
 	int areg = (v >> 3) & 0x7;
 	int sreg = v & 0x7;
-	writeIndirect(areg, R[sreg]);
+	writeIndirect(m, areg, m->R[sreg]);
 	return 9;
 }
-int MVOI(int v) // Move Out Immediate 0000:0010:0111:1sss
+int MVOI(intv_machine *m, int v) // Move Out Immediate 0000:0010:0111:1sss
 {
-	return(MVOa(v)); // call indirect copies R[sss] to address in R[PC]
+	return(MVOa(m, v)); // call indirect copies R[sss] to address in R[PC]
 }
-int MVI(int v) // 	Move In 0000:0010:1000:0rrr  aaaa:aaaa:aaaa:aaaa
+int MVI(intv_machine *m, int v) // 	Move In 0000:0010:1000:0rrr  aaaa:aaaa:aaaa:aaaa
 {
 	int reg = v & 0x07;
-	R[reg] = readOperandIndirect();
+	m->R[reg] = readOperandIndirect(m);
 	return 10 + EXTRA_IF_R6R7(reg);
 }
-int MVIa(int v) // Move In Indirect 0000:0010:10aa:addd
+int MVIa(intv_machine *m, int v) // Move In Indirect 0000:0010:10aa:addd
 {
 	int areg = (v >> 3) & 0x7;
 	int dreg = v & 0x7;	
-	R[dreg] = readIndirect(areg);
-    return (Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(dreg) + EXTRA_IF_R6(areg);
+	m->R[dreg] = readIndirect(m, areg);
+    return (m->Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(dreg) + EXTRA_IF_R6(areg);
 }
-int MVII(int v) // Move In Immediate (copies operand to register)
+int MVII(intv_machine *m, int v) // Move In Immediate (copies operand to register)
 {
 	// These instructions are only one word, so don't advance PC past operand.
 	// Auto incrementing registers will move past the operands automatically.
 	// This works exactly like MVI@ with PC as the address register.
 	// All nnnI instructions work this way.
 	v = v | 0x0038;  // set address register to PC
-	return(MVIa(v)); // call indirect
+	return(MVIa(m, v)); // call indirect
 }
-int ADD(int v) // Add
+int ADD(intv_machine *m, int v) // Add
 {
 	int reg = v & 0x07;
-	int val = readOperandIndirect();
-	R[reg] = AddSetSZOC(R[reg], val);
+	int val = readOperandIndirect(m);
+	m->R[reg] = AddSetSZOC(m, m->R[reg], val);
 	return 10 + EXTRA_IF_R6R7(reg);;
 }
-int ADDa(int v) // Add Indirect
+int ADDa(intv_machine *m, int v) // Add Indirect
 {
 	int areg = (v >> 3) & 0x07;
 	int dreg = v & 0x07;
-	int val = readIndirect(areg);
-	R[dreg] = AddSetSZOC(R[dreg], val);
-    return (Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
+	int val = readIndirect(m, areg);
+	m->R[dreg] = AddSetSZOC(m, m->R[dreg], val);
+    return (m->Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
 }
-int ADDI(int v) // Add Immediate
+int ADDI(intv_machine *m, int v) // Add Immediate
 {
 	v = v | 0x0038;  // set address register to PC
-	return(ADDa(v)); // call indirect
+	return(ADDa(m, v)); // call indirect
 }
-int SUB(int v) // Subtract
+int SUB(intv_machine *m, int v) // Subtract
 {
 	int reg = v & 0x07;
-	int val = readOperandIndirect();
-	R[reg] = SubSetOC(R[reg], val);
-	SetFlagsSZ(reg);
+	int val = readOperandIndirect(m);
+	m->R[reg] = SubSetOC(m, m->R[reg], val);
+	SetFlagsSZ(m, reg);
 	return 10 + EXTRA_IF_R6R7(reg);
 }
-int SUBa(int v)  // Subtract Indirect
+int SUBa(intv_machine *m, int v)  // Subtract Indirect
 {
 	int areg = (v >> 3) & 0x07;
 	int dreg = v & 0x07;
-	int val = readIndirect(areg);
-	R[dreg] = SubSetOC(R[dreg], val);
-	SetFlagsSZ(dreg);
-    return (Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
+	int val = readIndirect(m, areg);
+	m->R[dreg] = SubSetOC(m, m->R[dreg], val);
+	SetFlagsSZ(m, dreg);
+    return (m->Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
 }
-int SUBI(int v) // Subtract Immediate
+int SUBI(intv_machine *m, int v) // Subtract Immediate
 {
 	v = v | 0x0038;  // set address register to PC
-	return(SUBa(v)); // call indirect
+	return(SUBa(m, v)); // call indirect
 }
-int CMP(int v)
+int CMP(intv_machine *m, int v)
 {
 	int reg = v & 0x07;
-	int val = readOperandIndirect();
-	int res = SubSetOC(R[reg], val);
-	Flag_Sign = (res & 0x8000)!=0;
-	Flag_Zero = res==0;
+	int val = readOperandIndirect(m);
+	int res = SubSetOC(m, m->R[reg], val);
+	m->FlagSZ = res;
 	return 10 + EXTRA_IF_R6R7(reg);
 }
-int CMPa(int v)
+int CMPa(intv_machine *m, int v)
 {
 	int areg = (v >> 3) & 0x07;
 	int dreg = v & 0x07;
-	int val = readIndirect(areg);
-	int res = SubSetOC(R[dreg], val);
-	Flag_Sign = (res & 0x8000)!=0;
-	Flag_Zero = res==0;
-    return (Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
+	int val = readIndirect(m, areg);
+	int res = SubSetOC(m, m->R[dreg], val);
+	m->FlagSZ = res;
+    return (m->Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
 }
-int CMPI(int v) // CMP Immediate
+int CMPI(intv_machine *m, int v) // CMP Immediate
 {
 	v = v | 0x0038;  // set address register to PC
-	return(CMPa(v)); // call indirect
+	return(CMPa(m, v)); // call indirect
 }
-int AND(int v) // And
+int AND(intv_machine *m, int v) // And
 {
 	int reg = v & 0x07;
-	int val = readOperandIndirect();
-	R[reg] = R[reg] & val;
-	SetFlagsSZ(reg);
+	int val = readOperandIndirect(m);
+	m->R[reg] = m->R[reg] & val;
+	SetFlagsSZ(m, reg);
 	return 10 + EXTRA_IF_R6R7(reg);
 }
-int ANDa(int v) // And Indirect
+int ANDa(intv_machine *m, int v) // And Indirect
 {
 	int areg = (v >> 3) & 0x07;
 	int dreg = v & 0x07;
-	int val = readIndirect(areg);
-	R[dreg] = R[dreg] & val;
-	SetFlagsSZ(dreg);
-    return (Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
+	int val = readIndirect(m, areg);
+	m->R[dreg] = m->R[dreg] & val;
+	SetFlagsSZ(m, dreg);
+    return (m->Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
 }
-int ANDI(int v) // And Immediate
+int ANDI(intv_machine *m, int v) // And Immediate
 {
 	v = v | 0x0038;  // set address register to PC
-	return(ANDa(v)); // call indirect
+	return(ANDa(m, v)); // call indirect
 }
-int XOR(int v) // Xor
+int XOR(intv_machine *m, int v) // Xor
 {
 	int reg = v & 0x07;
-	int val = readOperandIndirect();
-	R[reg] = R[reg] ^ val;
-	SetFlagsSZ(reg);
+	int val = readOperandIndirect(m);
+	m->R[reg] = m->R[reg] ^ val;
+	SetFlagsSZ(m, reg);
 	return 10 + EXTRA_IF_R6R7(reg);
 }
-int XORa(int v) // Xor Indirect
+int XORa(intv_machine *m, int v) // Xor Indirect
 {
 	int areg = (v >> 3) & 0x07;
 	int dreg = v & 0x07;
-	int val = readIndirect(areg);
-	R[dreg] = R[dreg] ^ val;
-	SetFlagsSZ(dreg);
-    return (Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
+	int val = readIndirect(m, areg);
+	m->R[dreg] = m->R[dreg] ^ val;
+	SetFlagsSZ(m, dreg);
+    return (m->Flag_DoubleByteData == 1 ? 10 : 8) + EXTRA_IF_R6R7(areg) + EXTRA_IF_R6(areg);
 }
-int XORI(int v) // Xor Immediate
+int XORI(intv_machine *m, int v) // Xor Immediate
 {
 	v = v | 0x0038;  // set address register to PC
-	return(XORa(v)); // call indirect
+	return(XORa(m, v)); // call indirect
+}
+
+// Handlers specialized per instruction word //
+// The instruction word of the frequent register, shift, branch and indirect
+// move instructions fully determines their registers and condition, so each
+// word gets a copy of its handler with v fixed at compile time.  decode()
+// threads cache entries through these, which drops the field extraction and
+// condition switch from the execution path.
+#define SPECIALIZE_ROW_LO(X, op, hi) X(op, hi##0) X(op, hi##1) X(op, hi##2) X(op, hi##3) X(op, hi##4) X(op, hi##5) X(op, hi##6) X(op, hi##7)
+#define SPECIALIZE_ROW_HI(X, op, hi) X(op, hi##8) X(op, hi##9) X(op, hi##A) X(op, hi##B) X(op, hi##C) X(op, hi##D) X(op, hi##E) X(op, hi##F)
+#define SPECIALIZE_ROW(X, op, hi) SPECIALIZE_ROW_LO(X, op, hi) SPECIALIZE_ROW_HI(X, op, hi)
+
+#define SPECIALIZED_OPS(X) \
+	SPECIALIZE_ROW_HI(X, INCR, 0x00) \
+	SPECIALIZE_ROW_LO(X, DECR, 0x01) SPECIALIZE_ROW_HI(X, COMR, 0x01) \
+	SPECIALIZE_ROW_LO(X, NEGR, 0x02) SPECIALIZE_ROW_HI(X, ADCR, 0x02) \
+	SPECIALIZE_ROW_LO(X, SWAP, 0x04) SPECIALIZE_ROW_HI(X, SLL,  0x04) \
+	SPECIALIZE_ROW_LO(X, RLC,  0x05) SPECIALIZE_ROW_HI(X, SLLC, 0x05) \
+	SPECIALIZE_ROW_LO(X, SLR,  0x06) SPECIALIZE_ROW_HI(X, SAR,  0x06) \
+	SPECIALIZE_ROW_LO(X, RRC,  0x07) SPECIALIZE_ROW_HI(X, SARC, 0x07) \
+	SPECIALIZE_ROW(X, MOVR, 0x08) SPECIALIZE_ROW(X, MOVR, 0x09) SPECIALIZE_ROW(X, MOVR, 0x0A) SPECIALIZE_ROW(X, MOVR, 0x0B) \
+	SPECIALIZE_ROW(X, ADDR, 0x0C) SPECIALIZE_ROW(X, ADDR, 0x0D) SPECIALIZE_ROW(X, ADDR, 0x0E) SPECIALIZE_ROW(X, ADDR, 0x0F) \
+	SPECIALIZE_ROW(X, SUBR, 0x10) SPECIALIZE_ROW(X, SUBR, 0x11) SPECIALIZE_ROW(X, SUBR, 0x12) SPECIALIZE_ROW(X, SUBR, 0x13) \
+	SPECIALIZE_ROW(X, CMPR, 0x14) SPECIALIZE_ROW(X, CMPR, 0x15) SPECIALIZE_ROW(X, CMPR, 0x16) SPECIALIZE_ROW(X, CMPR, 0x17) \
+	SPECIALIZE_ROW(X, ANDR, 0x18) SPECIALIZE_ROW(X, ANDR, 0x19) SPECIALIZE_ROW(X, ANDR, 0x1A) SPECIALIZE_ROW(X, ANDR, 0x1B) \
+	SPECIALIZE_ROW(X, XORR, 0x1C) SPECIALIZE_ROW(X, XORR, 0x1D) SPECIALIZE_ROW(X, XORR, 0x1E) SPECIALIZE_ROW(X, XORR, 0x1F) \
+	SPECIALIZE_ROW(X, BranchCached, 0x20) SPECIALIZE_ROW(X, BranchCached, 0x22) /* BEXT is never cached */ \
+	SPECIALIZE_ROW_HI(X, MVOa, 0x24) SPECIALIZE_ROW(X, MVOa, 0x25) SPECIALIZE_ROW(X, MVOa, 0x26) SPECIALIZE_ROW(X, MVOa, 0x27) \
+	SPECIALIZE_ROW_HI(X, MVIa, 0x28) SPECIALIZE_ROW(X, MVIa, 0x29) SPECIALIZE_ROW(X, MVIa, 0x2A) SPECIALIZE_ROW(X, MVIa, 0x2B)
+
+#define SPECIALIZED_HANDLER(op, v) int op##_##v(intv_machine *m, int x) { return op(m, v); }
+#define SPECIALIZED_ENTRY(op, v) { v, op##_##v },
+
+SPECIALIZED_OPS(SPECIALIZED_HANDLER)
+
+const struct { int instruction; int (*op)(intv_machine *, int); } SpecializedOps[] = { SPECIALIZED_OPS(SPECIALIZED_ENTRY) };
+
+int (*Specialized[0x400])(intv_machine *, int); // per-word handler used by decode(), NULL = use OpCodes[]
+
+// Fill the cache entry for an address.  Returns NULL if the instruction
+// at adr must be fetched through readMem every time.
+const struct decoded *decode(intv_machine *m, int adr)
+{
+	struct decoded *d = &m->Decoded[adr & 0xFFFF];
+	int instruction;
+	int decle2, decle3;
+
+	if(!isCacheable(adr) || !isCacheable(adr+1) || !isCacheable(adr+2))
+	{
+		return NULL;
+	}
+	instruction = readMem(m, adr);
+	if(instruction > 0x03FF)
+	{
+		return NULL;
+	}
+
+	d->instruction = instruction;
+	d->operand = readMem(m, adr+1);
+	d->adr = 0;
+	d->flags = 0;
+	d->op = Specialized[instruction] ? Specialized[instruction] : OpCodes[instruction];
+
+	if(instruction==0x0004) // J, JE, JD, JSR, JSRE, JSRD, CALL
+	{
+		decle2 = readMem(m, adr+1);
+		decle3 = readMem(m, adr+2) & 0x3FF;
+		d->operand = ((decle2>>8) & 0x03)==3 ? 0 : ((decle2>>8) & 0x03) + 4;
+		d->adr = (((decle2>>2) & 0x3F)<<10) | decle3;
+		d->flags = decle2 & 0x03;
+		d->op = JumpCached;
+	}
+	return d;
+}
+
+const struct decoded *CP1610Decode(intv_machine *m, int adr)
+{
+	const struct decoded *d = &m->Decoded[adr & 0xFFFF];
+	return d->op != NULL ? d : decode(m, adr);
 }
 
 // Make a big table of function pointers for opcodes
 // as well as a table of flags so that opcodes can
 // be quickly executed and determined to be interuptable 
-void addInstruction(int start, int end, int caninterupt, const char *name, int (*callback)(int))
+void addInstruction(int start, int end, int caninterupt, const char *name, int (*callback)(intv_machine *, int))
 {
 	int i;
 	for(i=start; i<=end; i++)
@@ -731,6 +891,8 @@ void addInstruction(int start, int end, int caninterupt, const char *name, int (
 
 void CP1610Init()
 {
+	unsigned int i;
+
 	addInstruction(0x0000, 0x0000, 0, "HLT   ", HLT   );
 	addInstruction(0x0001, 0x0001, 0, "SDBD  ", SDBD  );
 	addInstruction(0x0002, 0x0002, 0, "EIS   ", EIS   );
@@ -786,4 +948,9 @@ void CP1610Init()
 	addInstruction(0x03C0, 0x03C7, 1, "XOR   ", XOR   );
 	addInstruction(0x03C8, 0x03F7, 1, "XOR@  ", XORa  );
 	addInstruction(0x03F8, 0x03FF, 1, "XORI  ", XORI  );
+
+	for(i=0; i<sizeof(SpecializedOps)/sizeof(SpecializedOps[0]); i++)
+	{
+		Specialized[SpecializedOps[i].instruction] = SpecializedOps[i].op;
+	}
 }
@@ -18,6 +18,10 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include "intv.h"
+
+struct decoded;
+
 struct CP1610serialized {
     int Flag_DoubleByteData;
     int Flag_InteruptEnable;
@@ -28,13 +32,30 @@ struct CP1610serialized {
     unsigned int R[8];
 };
 
-void CP1610Serialize(struct CP1610serialized *);
-void CP1610Unserialize(const struct CP1610serialized *);
+int FlagSign(intv_machine *m);
+int FlagZero(intv_machine *m);
+int FlagCarry(intv_machine *m);
+int FlagOverflow(intv_machine *m);
+
+void CP1610Serialize(intv_machine *m, struct CP1610serialized *);
+void CP1610Unserialize(intv_machine *m, const struct CP1610serialized *);
+
+void CP1610Init(void); // Adds opcodes to lookup tables (shared by all machines, see IntvInitTables)
+
+void CP1610Reset(intv_machine *m); // reset cpu
+
+int CP1610Tick(intv_machine *m, int debug); // execute a single instruction, return cycles used
+
+int CP1610TickDebug(intv_machine *m, int debug); // same, feeding the profiler and trace when enabled
+
+void CP1610FlushCache(intv_machine *m); // drop all predecoded instructions (after loading memory)
+
+void CP1610Invalidate(intv_machine *m, int adr); // drop predecoded instructions using the word at adr
 
-void CP1610Init(void); // Adds opcodes to lookup tables
+void CP1610SetCache(intv_machine *m, int mode); // 0 = plain interpreter, 1 = use predecoded instructions, 2 = also compile blocks (x86-64)
 
-void CP1610Reset(void); // reset cpu
+const struct decoded *CP1610Decode(intv_machine *m, int adr); // cache entry for adr, NULL if the instruction can't be cached
 
-int CP1610Tick(int debug); // execute a single instruction, return cycles used
+int CP1610Interrupt(intv_machine *m); // take the VBlank interrupt, returns cycles used
 
 #endif
@@ -0,0 +1,394 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "intv.h"
+#include "machine.h"
+#include "cp1610.h"
+#include "cp1610_jit.h"
+
+#ifdef CP1610_JIT
+#include <sys/mman.h>
+
+extern int Interuptable[0x400];
+
+// Basic-block compiler //
+// A block is a run of cached instructions (see decode() in cp1610.c) that
+// ends with the first one able to change R7 or the interrupt enable, so it
+// always runs from the top.  Register moves and arithmetic are translated
+// to x86, the rest call their handler with m->Current set, like Tick().
+//
+// Cycles are counted as RunCPU counts one Tick(): every instruction adds to
+// pending_ticks and phase_len as it finishes, so SyncAudio sees the same
+// numbers, and the block returns as soon as phase_len runs out.  Blocks
+// only start with SDBD clear and with SR1 clear or interrupts disabled, so
+// no interrupt can be taken before the last instruction.  The Interuptable[]
+// check is compiled in at the exit when the last instruction allows it.
+// After a store the block returns if it was flushed (code was written,
+// memory was remapped), the interpreter then carries on.
+
+#define JIT_CODE_SIZE (1<<20)   // per machine, all blocks are dropped when full
+#define JIT_BLOCK_LEN 32        // instructions
+#define JIT_INSTRUCTION_MAX 128 // bytes of x86 code for one instruction
+
+typedef int (*jitblock)(intv_machine *, unsigned int *);
+
+struct CP1610jit
+{
+	uint8_t *code; // read, write and execute
+	int used;
+	unsigned int flushes; // compiled stores compare this to notice a flush
+	jitblock block[0x10000]; // by start address, NULL = not compiled yet
+	uint8_t covered[0x10000]; // words read by compiled instructions
+};
+
+static int interpret(intv_machine *m, unsigned int *pc) // block[] entry where the first instruction can't be compiled
+{
+	(void) m; (void) pc;
+	return 0;
+}
+
+// x86-64 code.  rbx holds m, r12d the cycles run by the block, r13 the pc pointer.
+enum { EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI };
+
+#define REG(n) ((int)(offsetof(intv_machine, R) + (n)*sizeof(unsigned int)))
+#define FIELD(f) ((int)offsetof(intv_machine, f))
+
+static uint8_t *emit32(uint8_t *p, uint32_t v) { memcpy(p, &v, 4); return p+4; }
+static uint8_t *emit64(uint8_t *p, uint64_t v) { memcpy(p, &v, 8); return p+8; }
+
+static uint8_t *emitMem(uint8_t *p, int opcode, int reg, int field) // opcode with ModRM [rbx+field]
+{
+	*p++ = opcode;
+	*p++ = 0x83 | (reg<<3);
+	return emit32(p, field);
+}
+
+static uint8_t *emitJump(uint8_t *p, int cc, uint8_t *target) // jcc rel32, cc 0 = jmp
+{
+	if(cc==0) { *p++ = 0xE9; }
+	else { *p++ = 0x0F; *p++ = cc; }
+	return emit32(p, (uint32_t)(target - (p+4)));
+}
+
+static uint8_t *emitCall(uint8_t *p, const void *fn) // rdi = m, esi already set
+{
+	*p++ = 0x48; *p++ = 0x89; *p++ = 0xDF;      // mov rdi, rbx
+	*p++ = 0x48; *p++ = 0xB8;                   // mov rax, fn
+	p = emit64(p, (uint64_t)(uintptr_t)fn);
+	*p++ = 0xFF; *p++ = 0xD0;                   // call rax
+	return p;
+}
+
+static uint8_t *emitAccount(uint8_t *p) // count the cycles in eax
+{
+	*p++ = 0x41; *p++ = 0x01; *p++ = 0xC4;      // add r12d, eax
+	p = emitMem(p, 0x01, EAX, FIELD(pending_ticks));
+	return emitMem(p, 0x29, EAX, FIELD(phase_len));
+}
+
+// Register instructions done in x86, returns NULL for the others.
+// R7 is never the destination here (that ends the block in a handler).
+static uint8_t *translate(uint8_t *p, int v, int *ticks)
+{
+	int s = (v>>3) & 7;
+	int d = v & 7;
+
+	if(v==0x0006 || v==0x0007) // CLRC, SETC
+	{
+		p = emitMem(p, 0xC7, 0, FIELD(FlagC));
+		*ticks = 4;
+		return emit32(p, v==0x0007 ? 0x10000 : 0);
+	}
+	if(v==0x0034 || v==0x0035) { *ticks = 6; return p; } // NOP
+	if(d==7) { return NULL; }
+
+	*ticks = 6 + (d>=6 ? 1 : 0);
+	if(v>=0x0008 && v<=0x0017) // INCR, DECR
+	{
+		p = emitMem(p, 0x8B, EAX, REG(d));
+		*p++ = 0x83; *p++ = v<0x0010 ? 0xC0 : 0xE8; *p++ = 0x01; // add/sub eax, 1
+	}
+	else if(v>=0x0080 && v<=0x00BF) // MOVR
+	{
+		p = emitMem(p, 0x8B, EAX, REG(s));
+	}
+	else if(v>=0x00C0 && v<=0x00FF) // ADDR, flags as AddSetSZOC
+	{
+		p = emitMem(p, 0x8B, EAX, REG(d));
+		p = emitMem(p, 0x8B, ECX, REG(s));
+		*p++ = 0x8D; *p++ = 0x14; *p++ = 0x08;  // lea edx, [rax+rcx]
+		p = emitMem(p, 0x89, EDX, FIELD(FlagC));
+		*p++ = 0x89; *p++ = 0xC6;               // mov esi, eax
+		*p++ = 0x31; *p++ = 0xCE;               // xor esi, ecx
+		*p++ = 0xF7; *p++ = 0xD6;               // not esi
+		*p++ = 0x31; *p++ = 0xD0;               // xor eax, edx
+		*p++ = 0x21; *p++ = 0xF0;               // and eax, esi
+		p = emitMem(p, 0x89, EAX, FIELD(FlagO));
+		*p++ = 0x89; *p++ = 0xD0;               // mov eax, edx
+	}
+	else if(v>=0x0100 && v<=0x017F) // SUBR, CMPR, flags as SubSetOC
+	{
+		p = emitMem(p, 0x8B, EAX, REG(d));
+		p = emitMem(p, 0x8B, ECX, REG(s));
+		*p++ = 0x89; *p++ = 0xCA;               // mov edx, ecx
+		*p++ = 0x81; *p++ = 0xF2; p = emit32(p, 0xFFFF); // xor edx, 0xFFFF
+		*p++ = 0x8D; *p++ = 0x54; *p++ = 0x10; *p++ = 0x01; // lea edx, [rax+rdx+1]
+		p = emitMem(p, 0x89, EDX, FIELD(FlagC));
+		*p++ = 0x89; *p++ = 0xC6;               // mov esi, eax
+		*p++ = 0x31; *p++ = 0xCE;               // xor esi, ecx
+		*p++ = 0x31; *p++ = 0xD0;               // xor eax, edx
+		*p++ = 0x21; *p++ = 0xF0;               // and eax, esi
+		p = emitMem(p, 0x89, EAX, FIELD(FlagO));
+		*p++ = 0x89; *p++ = 0xD0;               // mov eax, edx
+		if(v>=0x0140) // CMPR only sets the flags
+		{
+			*p++ = 0x25; p = emit32(p, 0xFFFF); // and eax, 0xFFFF
+			return emitMem(p, 0x89, EAX, FIELD(FlagSZ));
+		}
+	}
+	else if(v>=0x0180 && v<=0x01FF) // ANDR, XORR
+	{
+		p = emitMem(p, 0x8B, EAX, REG(d));
+		p = emitMem(p, 0x8B, ECX, REG(s));
+		*p++ = v<0x01C0 ? 0x21 : 0x31; *p++ = 0xC8; // and/xor eax, ecx
+	}
+	else
+	{
+		return NULL;
+	}
+	// SetFlagsSZ
+	*p++ = 0x25; p = emit32(p, 0xFFFF);         // and eax, 0xFFFF
+	p = emitMem(p, 0x89, EAX, REG(d));
+	return emitMem(p, 0x89, EAX, FIELD(FlagSZ));
+}
+
+// Interrupt check after the last instruction, as at the end of Tick().
+// SR1 is only counted down by RunCPU once the block returns.
+static int blockExit(intv_machine *m, int ticks)
+{
+	if(m->Flag_InteruptEnable == 1 && m->SR1 - ticks > 0)
+	{
+		return CP1610Interrupt(m);
+	}
+	return 0;
+}
+
+static int endsBlock(int v) // can change R7 or the interrupt enable
+{
+	return v==0x0002 || v==0x0003 || v==0x0004 || (v>=0x0200 && v<=0x023F) || (v>=0x0008 && (v & 7)==7);
+}
+
+static int isStore(int v) { return v>=0x0240 && v<=0x027F; } // MVO, MVO@, PSHR, MVOI
+
+static int length(int v) // words, with SDBD clear
+{
+	int areg = (v>>3) & 7;
+	return (v>=0x0240 && (areg==0 || areg==7)) ? 2 : 1; // direct address or immediate operand
+}
+
+static const struct decoded *compilable(intv_machine *m, int adr)
+{
+	const struct decoded *d = adr <= 0xFFFF ? CP1610Decode(m, adr) : NULL;
+	if(d == NULL || d->instruction <= 0x0001) { return NULL; } // HLT, SDBD
+	return d;
+}
+
+static jitblock compile(intv_machine *m, struct CP1610jit *jit, int adr)
+{
+	const struct decoded *d = compilable(m, adr);
+	const struct decoded *next;
+	uint8_t *p, *q, *exit, *entry;
+	int start = adr;
+	int n, v, ticks;
+
+	if(d == NULL)
+	{
+		return jit->block[start] = interpret;
+	}
+	if(jit->used + JIT_BLOCK_LEN*JIT_INSTRUCTION_MAX + 64 > JIT_CODE_SIZE)
+	{
+		CP1610JitFlush(m);
+	}
+	p = exit = jit->code + jit->used;
+
+	// exit, in front of the entry so every jump to it is backwards
+	*p++ = 0x48; p = emitMem(p, 0xC7, 0, FIELD(Current)); p = emit32(p, 0); // mov qword m->Current, 0
+	*p++ = 0x44; *p++ = 0x89; *p++ = 0xE0;      // mov eax, r12d
+	*p++ = 0x48; *p++ = 0x83; *p++ = 0xC4; *p++ = 0x08; // add rsp, 8
+	*p++ = 0x41; *p++ = 0x5E;                   // pop r14
+	*p++ = 0x41; *p++ = 0x5D;                   // pop r13
+	*p++ = 0x41; *p++ = 0x5C;                   // pop r12
+	*p++ = 0x5B;                                // pop rbx
+	*p++ = 0xC3;                                // ret
+
+	entry = p;
+	*p++ = 0x53;                                // push rbx
+	*p++ = 0x41; *p++ = 0x54;                   // push r12
+	*p++ = 0x41; *p++ = 0x55;                   // push r13
+	*p++ = 0x41; *p++ = 0x56;                   // push r14
+	*p++ = 0x48; *p++ = 0x83; *p++ = 0xEC; *p++ = 0x08; // sub rsp, 8
+	*p++ = 0x48; *p++ = 0x89; *p++ = 0xFB;      // mov rbx, rdi
+	*p++ = 0x49; *p++ = 0x89; *p++ = 0xF5;      // mov r13, rsi
+	*p++ = 0x45; *p++ = 0x31; *p++ = 0xE4;      // xor r12d, r12d
+
+	for(n=1; d != NULL; n++)
+	{
+		v = d->instruction;
+		next = (endsBlock(v) || n==JIT_BLOCK_LEN) ? NULL : compilable(m, adr + length(v));
+		jit->covered[adr] = jit->covered[(adr+1) & 0xFFFF] = jit->covered[(adr+2) & 0xFFFF] = 1; // as CP1610Invalidate
+
+		*p++ = 0x41; *p++ = 0xC7; *p++ = 0x45; *p++ = 0x00; p = emit32(p, adr); // mov dword [r13], adr
+		p = emitMem(p, 0xC7, 0, REG(7)); p = emit32(p, adr+1); // PC at the operand, as in Tick()
+
+		q = translate(p, v, &ticks);
+		if(q != NULL)
+		{
+			p = q;
+			*p++ = 0xB8; p = emit32(p, ticks);  // mov eax, ticks
+		}
+		else
+		{
+			*p++ = 0x48; p = emitMem(p, 0x8D, EAX, FIELD(Decoded) + adr*(int)sizeof(struct decoded)); // lea rax, m->Decoded[adr]
+			*p++ = 0x48; p = emitMem(p, 0x89, EAX, FIELD(Current)); // mov m->Current, rax
+			*p++ = 0xBE; p = emit32(p, v);      // mov esi, v
+			p = emitCall(p, (const void *)d->op);
+		}
+		if(next == NULL && Interuptable[v])
+		{
+			*p++ = 0x41; *p++ = 0x89; *p++ = 0xC6;  // mov r14d, eax
+			*p++ = 0x44; *p++ = 0x89; *p++ = 0xE6;  // mov esi, r12d
+			p = emitCall(p, (const void *)blockExit);
+			*p++ = 0x44; *p++ = 0x01; *p++ = 0xF0;  // add eax, r14d
+		}
+		p = emitAccount(p);
+
+		if(next != NULL)
+		{
+			p = emitJump(p, 0x88, exit);    // js exit, phase_len ran out
+			if(isStore(v))
+			{
+				*p++ = 0x48; *p++ = 0xB8; p = emit64(p, (uint64_t)(uintptr_t)&jit->flushes); // mov rax, &flushes
+				*p++ = 0x81; *p++ = 0x38; p = emit32(p, jit->flushes); // cmp dword [rax], flushes
+				p = emitJump(p, 0x85, exit); // jne exit
+			}
+		}
+		adr += length(v);
+		d = next;
+	}
+	p = emitJump(p, 0, exit);
+
+	jit->used = (int)(p - jit->code);
+	return jit->block[start] = (jitblock)entry;
+}
+
+struct CP1610jit *CP1610JitCreate(void)
+{
+	struct CP1610jit *jit = (struct CP1610jit *) calloc(1, sizeof(struct CP1610jit));
+	void *code;
+
+	if(jit == NULL) { return NULL; }
+	code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(code == MAP_FAILED)
+	{
+		free(jit);
+		return NULL;
+	}
+	jit->code = (uint8_t *)code;
+	return jit;
+}
+
+void CP1610JitFree(intv_machine *m)
+{
+	if(m->Jit != NULL)
+	{
+		munmap(m->Jit->code, JIT_CODE_SIZE);
+		free(m->Jit);
+		m->Jit = NULL;
+	}
+}
+
+int CP1610JitRun(intv_machine *m, unsigned int *pc)
+{
+	struct CP1610jit *jit = m->Jit;
+	jitblock block;
+
+	if(m->R[7] > 0xFFFF || m->Flag_DoubleByteData != 0 || (m->SR1 > 0 && m->Flag_InteruptEnable == 1))
+	{
+		return 0;
+	}
+	block = jit->block[m->R[7]];
+	if(block == NULL)
+	{
+		block = compile(m, jit, m->R[7]);
+	}
+	return block(m, pc);
+}
+
+void CP1610JitFlush(intv_machine *m)
+{
+	struct CP1610jit *jit = m->Jit;
+
+	if(jit != NULL)
+	{
+		jit->used = 0;
+		jit->flushes++;
+		memset(jit->block, 0, sizeof(jit->block));
+		memset(jit->covered, 0, sizeof(jit->covered));
+	}
+}
+
+void CP1610JitInvalidate(intv_machine *m, int adr)
+{
+	if(m->Jit != NULL && m->Jit->covered[adr & 0xFFFF])
+	{
+		CP1610JitFlush(m);
+	}
+}
+
+#else
+
+struct CP1610jit *CP1610JitCreate(void)
+{
+	return NULL; // no compiler for this target
+}
+
+void CP1610JitFree(intv_machine *m)
+{
+	(void) m;
+}
+
+int CP1610JitRun(intv_machine *m, unsigned int *pc)
+{
+	(void) m; (void) pc;
+	return 0;
+}
+
+void CP1610JitFlush(intv_machine *m)
+{
+	(void) m;
+}
+
+void CP1610JitInvalidate(intv_machine *m, int adr)
+{
+	(void) m; (void) adr;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef CP1610_JIT_H
+#define CP1610_JIT_H
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "intv.h"
+
+// Native code for straight-line CP-1610 code on x86-64, build with
+// NO_CP1610_JIT to leave it out.  Elsewhere the functions below exist
+// but CP1610JitCreate returns NULL, so the interpreter runs everything.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(_WIN32) && !defined(NO_CP1610_JIT)
+#define CP1610_JIT
+#endif
+
+struct CP1610jit *CP1610JitCreate(void); // NULL when unsupported or out of memory
+
+void CP1610JitFree(intv_machine *m);
+
+int CP1610JitRun(intv_machine *m, unsigned int *pc); // run the block at R7, returns cycles (0 = interpret one instruction), *pc = last instruction run
+
+void CP1610JitFlush(intv_machine *m); // drop all compiled blocks
+
+void CP1610JitInvalidate(intv_machine *m, int adr); // drop all compiled blocks if one uses the word at adr
+
+#endif
@@ -17,28 +17,229 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "intv.h"
+#include "machine.h"
 #include "memory.h"
 #include "cp1610.h"
+#include "cp1610_jit.h"
 #include "stic.h"
 #include "psg.h"
 #include "controller.h"
 #include "cart.h"
 #include "osd.h"
 #include "ivoice.h"
+#include "profile.h"
+#include "trace.h"
+#include "bench.h"
+
+#include <retro_inline.h>
 
 #ifdef __LIBRETRO__
 #include <streams/file_stream.h>
 #endif
 
-int SR1;
-int intv_halt;
+// CPU cycles not yet run on the PSG and Intellivoice.  Both only depend on
+// the time elapsed between register accesses, so exec() lets cycles pile up
+// and the memory handlers call SyncAudio before touching their registers.
+// The STIC bus requests sync too, so their long ticks land exactly as before.
 
-int exec(void);
+void SyncAudio(intv_machine *m)
+{
+	if(m->pending_ticks > 0)
+	{
+		BENCH(BENCH_PSG, PSGTick(m, m->pending_ticks));
+		BENCH(BENCH_IVOICE, ivoice_tk_batch(m, m->pending_ticks));
+		m->pending_ticks = 0;
+	}
+}
+
+// Idle loop detection.  Games often spin until the next interrupt, either
+// with a branch to self or by polling RAM that won't change.  When the CPU
+// jumps back to the same address twice with the registers and flags
+// unchanged and no memory writes (or reads with side effects) in between,
+// every further pass is identical until the next STIC phase, so exec()
+// skips whole passes up to the phase_len deadline.
 
-void LoadGame(const char* path) // load cart rom //
+void IdleCheck(intv_machine *m)
 {
-	if(LoadCart(path))
+	struct CP1610serialized cpu;
+	int skip;
+
+	CP1610Serialize(m, &cpu);
+	if(m->idle_pc == m->R[7] && m->idle_events == m->mem_events &&
+	   (m->SR1 == 0 || cpu.Flag_InteruptEnable == 0) &&
+	   memcmp(&cpu, &m->idle_cpu, sizeof(cpu)) == 0)
+	{
+		skip = m->phase_len - m->phase_len % m->idle_ticks;
+		m->pending_ticks += skip;
+		m->phase_len -= skip;
+		if(m->SR1>0)
+		{
+			m->SR1 = m->SR1 - skip;
+			if(m->SR1<0) { m->SR1 = 0; }
+		}
+	}
+	m->idle_pc = m->R[7];
+	m->idle_ticks = 0;
+	m->idle_events = m->mem_events;
+	m->idle_cpu = cpu;
+}
+
+int exec(intv_machine *m);
+
+#define SERIALIZED_VERSION 0x4f544704
+
+// Savestates.  The header is followed by 16-bit words: each writable page
+// of Memory (see MemoryPageWritable), then the PSG and Intellivoice samples
+// not played yet.  ROM comes back by loading the game and frame[] is drawn
+// again, so a state is a small part of the machine.
+struct serialized {
+	int version;
+	int size; // bytes used, header included
+	unsigned char pages[32]; // bitmap of the saved Memory pages
+	struct CP1610serialized CP1610;
+	struct STICserialized STIC;
+	struct PSGserialized PSG;
+	struct ivoiceSerialized ivoice;
+	int SR1;
+	int intv_halt;
+	int pending_ticks;
+};
+
+void serializedPages(intv_machine *m, unsigned char *pages)
+{
+	int page;
+
+	memset(pages, 0, 32);
+	for(page=0; page<256; page++)
+	{
+		if(MemoryPageWritable(m, page))
+		{
+			pages[page>>3] |= 1<<(page&7);
+		}
+	}
+}
+
+size_t IntvSerializeSize(intv_machine *m)
+{
+	int page;
+	size_t words = 0;
+
+	for(page=0; page<256; page++)
+	{
+		if(MemoryPageWritable(m, page)) { words += 256; }
+	}
+	words += sizeof(m->PSGBuffer) / sizeof(int16_t);
+	words += sizeof(m->ivoiceBuffer) / sizeof(int16_t) + SCBUF_SIZE;
+	return sizeof(struct serialized) + words * sizeof(uint16_t);
+}
+
+size_t IntvSerialize(intv_machine *m, void *data, size_t size)
+{
+	struct serialized *all = (struct serialized *) data;
+	uint16_t *words = (uint16_t *) (all + 1);
+	int page, i;
+
+	if(size < IntvSerializeSize(m))
+	{
+		return 0;
+	}
+	all->version = SERIALIZED_VERSION;
+	serializedPages(m, all->pages);
+	CP1610Serialize(m, &all->CP1610);
+	STICSerialize(m, &all->STIC);
+	PSGSerialize(m, &all->PSG);
+	ivoiceSerialize(m, &all->ivoice);
+	all->SR1 = m->SR1;
+	all->intv_halt = m->intv_halt;
+	all->pending_ticks = m->pending_ticks;
+
+	for(page=0; page<256; page++)
+	{
+		if(all->pages[page>>3] & (1<<(page&7)))
+		{
+			for(i=0; i<256; i++)
+			{
+				*words++ = m->Memory[(page<<8) + i];
+			}
+		}
+	}
+	words += PSGSerializeBuffer(m, (int16_t *) words);
+	words += ivoiceSerializeAudio(m, (int16_t *) words);
+	all->size = (unsigned char *) words - (unsigned char *) data;
+	return all->size;
+}
+
+int IntvUnserialize(intv_machine *m, const void *data, size_t size)
+{
+	const struct serialized *all = (const struct serialized *) data;
+	const uint16_t *words = (const uint16_t *) (all + 1);
+	unsigned char pages[32];
+	int page, i, left, used;
+
+	if(size < sizeof(struct serialized) || all->version != SERIALIZED_VERSION ||
+	   all->size < (int) sizeof(struct serialized) || (size_t) all->size > size)
+	{
+		return 0;
+	}
+	serializedPages(m, pages);
+	if(memcmp(pages, all->pages, sizeof(pages)) != 0) // another memory map, another game
+	{
+		return 0;
+	}
+	left = (all->size - sizeof(struct serialized)) / sizeof(uint16_t);
+	for(page=0; page<256; page++)
+	{
+		if(pages[page>>3] & (1<<(page&7))) { left -= 256; }
+	}
+	if(left < 0)
+	{
+		return 0;
+	}
+	used = PSGCheckBuffer(&all->PSG, left);
+	if(used < 0 || ivoiceCheckAudio(&all->ivoice, left - used) < 0)
+	{
+		return 0;
+	}
+
+	// The whole state checked out, nothing in m was touched before here
+	CP1610Unserialize(m, &all->CP1610);
+	STICUnserialize(m, &all->STIC);
+	PSGUnserialize(m, &all->PSG);
+	ivoiceUnserialize(m, &all->ivoice);
+	m->SR1 = all->SR1;
+	m->intv_halt = all->intv_halt;
+	m->pending_ticks = all->pending_ticks;
+
+	for(page=0; page<256; page++)
+	{
+		if(pages[page>>3] & (1<<(page&7)))
+		{
+			for(i=0; i<256; i++)
+			{
+				m->Memory[(page<<8) + i] = *words++;
+			}
+		}
+	}
+	words += PSGUnserializeBuffer(m, (const int16_t *) words);
+	ivoiceUnserializeAudio(m, (const int16_t *) words);
+	CP1610FlushCache(m); // Memory was replaced behind the predecode cache
+	MemoryMarkAllDirty(m);
+
+	// States are taken between frames, right after the frame was drawn.
+	// Drawing it again ORs the same collision bits into $18-$1F, so only
+	// frame[] changes.
+	if(m->stic_phase == 0)
+	{
+		STICDrawFrame(m, m->stic_vid_enable);
+	}
+	return 1;
+}
+
+void LoadGame(intv_machine *m, const char* path) // load cart rom //
+{
+	if(LoadCart(m, path))
 	{
 		OSD_drawText(3, 3, "LOAD CART: OKAY");
 	}
@@ -46,9 +247,11 @@ void LoadGame(const char* path) // load cart rom //
 	{
 		OSD_drawText(3, 3, "LOAD CART: FAIL");
 	}
+	MemoryMarkAllDirty(m);
+	CP1610FlushCache(m);
 }
 
-void loadExec(const char* path)
+void loadExec(intv_machine *m, const char* path)
 {
 	// EXEC lives at 0x1000-0x1FFF
 	int i;
@@ -66,7 +269,7 @@ void loadExec(const char* path)
 		for(i=0x1000; i<=0x1FFF; i++)
 		{
 			filestream_read(fp, word, sizeof(word));
-			Memory[i] = (word[0]<<8) | word[1];
+			m->Memory[i] = (word[0]<<8) | word[1];
 		}
 
 		filestream_close(fp);
@@ -79,7 +282,7 @@ void loadExec(const char* path)
 		for(i=0x1000; i<=0x1FFF; i++)
 		{
 			fread(word,sizeof(word),1,fp);
-			Memory[i] = (word[0]<<8) | word[1];
+			m->Memory[i] = (word[0]<<8) | word[1];
 		}
 
 		fclose(fp);
@@ -93,9 +296,10 @@ void loadExec(const char* path)
         OSD_drawTextBG(3, 6, "PUT GROM/EXEC IN SYSTEM DIRECTORY");
 		printf("[ERROR] [FREEINTV] Failed loading Executive BIOS from: %s\n", path);
 	}
+	MemoryMarkAllDirty(m);
 }
 
-void loadGrom(const char* path)
+void loadGrom(intv_machine *m, const char* path)
 {
 	// GROM lives at 0x3000-0x37FF
 	int i;
@@ -113,7 +317,7 @@ void loadGrom(const char* path)
 		for(i=0x3000; i<=0x37FF; i++)
 		{
 			filestream_read(fp, word, sizeof(word));
-			Memory[i] = word[0];
+			m->Memory[i] = word[0];
 		}
 
 		filestream_close(fp);
@@ -126,7 +330,7 @@ void loadGrom(const char* path)
 		for(i=0x3000; i<=0x37FF; i++)
 		{
 			fread(word,sizeof(word),1,fp);
-			Memory[i] = word[0];
+			m->Memory[i] = word[0];
 		}
 
 		fclose(fp);
@@ -141,132 +345,203 @@ void loadGrom(const char* path)
         OSD_drawTextBG(3, 6, "PUT GROM/EXEC IN SYSTEM DIRECTORY");
 		printf("[ERROR] [FREEINTV] Failed loading Graphics BIOS from: %s\n", path);
 	}
+	MemoryMarkAllDirty(m);
+}
+
+void Reset(intv_machine *m)
+{
+	m->SR1 = 0;
+    m->intv_halt = 0;
+    m->pending_ticks = 0;
+    m->idle_pc = -1;
+	CP1610Reset(m);
+	STICReset(m);
+    ivoice_reset(m);
 }
 
-void Reset()
+void Init(intv_machine *m)
 {
-	SR1 = 0;
-    intv_halt = 0;
-	CP1610Reset();
-	STICReset();
-    ivoice_reset();
+	MemoryInit(m);
+    PSGInit(m);
+    ivoice_init(m, 0, 1.0);
 }
 
-void Init()
+// The opcode and STIC tables are read by every machine and written here
+// only, so this runs before any machine exists (or while none is running).
+void IntvInitTables(void)
 {
 	CP1610Init();
-	MemoryInit();
-    PSGInit();
-    ivoice_init(0, 1.0);
+	STICInit();
+}
+
+intv_machine *IntvCreate(void)
+{
+	intv_machine *m = (intv_machine *) calloc(1, sizeof(intv_machine));
+
+	if(m != NULL)
+	{
+		IntvPowerCycle(m);
+	}
+	return m;
 }
 
-void Run()
+// Only touches the machine, so worker threads can recycle theirs between
+// jobs while other machines run.  A render thread is stopped.
+void IntvPowerCycle(intv_machine *m)
+{
+	STICThreadStop(m);
+	CP1610JitFree(m);
+	memset(m, 0, sizeof(intv_machine));
+	CP1610SetCache(m, 1); // compiled blocks are opt-in, see freeintv_cpu_cache
+	Init(m);
+	Reset(m);
+}
+
+void IntvDestroy(intv_machine *m)
+{
+	if(m != NULL)
+	{
+		STICThreadStop(m);
+		CP1610JitFree(m);
+	}
+	free(m);
+}
+
+void Run(intv_machine *m)
 {
     // run for one frame
 	// exec will call drawFrame for us only when needed
-	while(exec()) { }
+	while(exec(m)) { }
 }
 
-int exec(void) // Run one instruction 
+// Run instructions until the next STIC phase change, returns 0 on halt.
+// exec() picks the debug copy (profiler, trace) once per phase.  Compiled
+// blocks run several instructions per step and count their own
+// pending_ticks and phase_len, pc is then their last instruction.
+static INLINE int RunCPU(intv_machine *m, const int debug)
 {
     int ticks;
-    
-    ticks = CP1610Tick(0); // Tick CP-1610 CPU, runs one instruction, returns used cycles
+    unsigned int pc;
 
-	if(ticks==0)    // Undefined instruction (>= 0x0400) or HLT
-	{
-        // DEBUG
-#if 0
+    do {
+        pc = m->R[7];
+        ticks = (!debug && m->Jit != NULL) ? CP1610JitRun(m, &pc) : 0;
+        if(ticks==0)
         {
-            FILE *debug_file;
-            extern unsigned int R[];
+            // Tick CP-1610 CPU, runs one instruction, returns used cycles
+            ticks = debug ? CP1610TickDebug(m, 0) : CP1610Tick(m, 0);
+
+            if(ticks==0)    // Undefined instruction (>= 0x0400) or HLT
+            {
+                // With tracing on, the trace ring ends with this instruction
+                SyncAudio(m);
+                m->intv_halt = 1;
+                return 0;
+            }
 
-            fprintf(stdout, "%04x:[%03x] %04x %04x %04x %04x %04x %04x %04x\n", R[7] - 1, readMem(R[7] - 1), R[0], R[1], R[2], R[3], R[4], R[5], R[6]);
-            fprintf(stdout, "%04x:[%03x] %04x %04x %04x %04x %04x %04x %04x\n", R[7], readMem(R[7]), R[0], R[1], R[2], R[3], R[4], R[5], R[6]);
+            // PSG and Intellivoice catch up in SyncAudio
+            m->pending_ticks += ticks;
+            m->phase_len -= ticks;
+        }
+
+        if(m->SR1>0)
+        {
+            m->SR1 = m->SR1 - ticks;
+            if(m->SR1<0) { m->SR1 = 0; }
         }
-#endif
-        intv_halt = 1;
-		return 0;
-	}
 
-	// Tick PSG
-	PSGTick(ticks);
- 
-    // Tick Intellivoice
-    ivoice_tk(ticks);
-    
-    if(SR1>0)
+        m->idle_ticks += ticks;
+        if(m->R[7] <= pc && m->phase_len >= 0) // backward jump, could be an idle loop
+        {
+            IdleCheck(m);
+        }
+    } while (m->phase_len >= 0);
+    return 1;
+}
+
+int exec(intv_machine *m) // Run the CPU until the next STIC phase change, then step the STIC
+{
+    m->idle_pc = -1; // STIC state changes between phases
+    if(!((ProfileEnabled || TraceEnabled) ? RunCPU(m, 1) : RunCPU(m, 0)))
     {
-        SR1 = SR1 - ticks;
-        if(SR1<0) { SR1 = 0; }
+        return 0;
     }
-    
-    phase_len -= ticks;
-    if (phase_len < 0) {
-        stic_phase = (stic_phase + 1) & 15;
-        switch (stic_phase) {
-            case 0: // Start of VBLANK
-                stic_reg = 1;   // STIC registers accessible
-                stic_gram = 1;  // GRAM accessible
-                phase_len += 2900;
-                SR1 = phase_len;
-                // Render Frame //
-                STICDrawFrame(stic_vid_enable);
-                // The following line was below just after
-                //   "stic_vid_enable = DisplayEnabled;"
-                // It caused D1K Homebrew to fail:
-                // o D1K misses a video interrupt.
-                // o However it updates DisplayEnabled in time (writing to 0x20)
-                // o So the DisplayEnabled variable should be reset here.
-                DisplayEnabled = 0;
-                return 0;
-            case 1:
-                phase_len += 3796 - 2900;
-                stic_vid_enable = DisplayEnabled;
-                if (stic_vid_enable)
-                    stic_reg = 0;   // STIC registers now inaccessible
-                stic_gram = 1;  // GRAM accessible
-                break;
-            case 2:
-                delayV = ((Memory[0x31])&0x7);
-                delayH = ((Memory[0x30])&0x7);
-                phase_len += 120 + 114 * delayV + delayH;
-                if (stic_vid_enable) {
-                    stic_gram = 0;  // GRAM now inaccessible
-                    phase_len -= 68;    // BUSRQ period (STIC reads RAM)
-                    PSGTick(68);
-                    ivoice_tk(68);
-                }
-                break;
-            default:
-                phase_len += 912;
-                if (stic_vid_enable) {
-                    phase_len -= 108;   // BUSRQ period (STIC reads RAM)
-                    PSGTick(108);
-                    ivoice_tk(108);
-                }
-                break;
-            case 14:
-                delayV = ((Memory[0x31])&0x7);
-                delayH = ((Memory[0x30])&0x7);
-                phase_len += 912 - 114 * delayV - delayH;
-                if (stic_vid_enable) {
-                    phase_len -= 108;   // BUSRQ period (STIC reads RAM)
-                    PSGTick(108);
-                    ivoice_tk(108);
-                }
-                break;
-            case 15:
-                delayV = ((Memory[0x31])&0x7);
-                phase_len += 57 + 17;
-                if (stic_vid_enable && delayV == 0) {
-                    phase_len -= 38;    // BUSRQ period (STIC reads RAM)
-                    PSGTick(38);
-                    ivoice_tk(38);
-                }
-                break;
-                
-        }
+
+    m->stic_phase = (m->stic_phase + 1) & 15;
+    switch (m->stic_phase) {
+        case 0: // Start of VBLANK
+            m->stic_reg = 1;   // STIC registers accessible
+            m->stic_gram = 1;  // GRAM accessible
+            m->phase_len += 2900;
+            m->SR1 = m->phase_len;
+            // Render Frame //
+            SyncAudio(m);
+            if(m->SkipVideo)
+            {
+                BENCH(BENCH_STIC, STICCollideFrame(m, m->stic_vid_enable));
+            }
+            else
+            {
+                BENCH(BENCH_STIC, STICQueueFrame(m, m->stic_vid_enable));
+            }
+            // The following line was below just after
+            //   "stic_vid_enable = DisplayEnabled;"
+            // It caused D1K Homebrew to fail:
+            // o D1K misses a video interrupt.
+            // o However it updates DisplayEnabled in time (writing to 0x20)
+            // o So the DisplayEnabled variable should be reset here.
+            m->DisplayEnabled = 0;
+            return 0;
+        case 1:
+            m->phase_len += 3796 - 2900;
+            m->stic_vid_enable = m->DisplayEnabled;
+            if (m->stic_vid_enable)
+                m->stic_reg = 0;   // STIC registers now inaccessible
+            m->stic_gram = 1;  // GRAM accessible
+            break;
+        case 2:
+            m->delayV = ((m->Memory[0x31])&0x7);
+            m->delayH = ((m->Memory[0x30])&0x7);
+            m->phase_len += 120 + 114 * m->delayV + m->delayH;
+            if (m->stic_vid_enable) {
+                m->stic_gram = 0;  // GRAM now inaccessible
+                m->phase_len -= 68;    // BUSRQ period (STIC reads RAM)
+                SyncAudio(m);
+                BENCH(BENCH_PSG, PSGTick(m, 68));
+                BENCH(BENCH_IVOICE, ivoice_tk(m, 68));
+            }
+            break;
+        default:
+            m->phase_len += 912;
+            if (m->stic_vid_enable) {
+                m->phase_len -= 108;   // BUSRQ period (STIC reads RAM)
+                SyncAudio(m);
+                BENCH(BENCH_PSG, PSGTick(m, 108));
+                BENCH(BENCH_IVOICE, ivoice_tk(m, 108));
+            }
+            break;
+        case 14:
+            m->delayV = ((m->Memory[0x31])&0x7);
+            m->delayH = ((m->Memory[0x30])&0x7);
+            m->phase_len += 912 - 114 * m->delayV - m->delayH;
+            if (m->stic_vid_enable) {
+                m->phase_len -= 108;   // BUSRQ period (STIC reads RAM)
+                SyncAudio(m);
+                BENCH(BENCH_PSG, PSGTick(m, 108));
+                BENCH(BENCH_IVOICE, ivoice_tk(m, 108));
+            }
+            break;
+        case 15:
+            m->delayV = ((m->Memory[0x31])&0x7);
+            m->phase_len += 57 + 17;
+            if (m->stic_vid_enable && m->delayV == 0) {
+                m->phase_len -= 38;    // BUSRQ period (STIC reads RAM)
+                SyncAudio(m);
+                BENCH(BENCH_PSG, PSGTick(m, 38));
+                BENCH(BENCH_IVOICE, ivoice_tk(m, 38));
+            }
+            break;
+            
     }
     return 1;
 }
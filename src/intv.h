@@ -18,22 +18,38 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <stddef.h>
+
 #define AUDIO_FREQUENCY     44100
 
-extern int SR1; // SR1 line for interrupt
+typedef struct intv_machine intv_machine; // one console, see machine.h
+
+void IntvInitTables(void); // build the tables shared by all machines, once, before the first IntvCreate
+
+intv_machine *IntvCreate(void); // allocate a machine, returns it initialized and reset (NULL if out of memory)
+
+void IntvDestroy(intv_machine *m);
+
+void IntvPowerCycle(intv_machine *m); // clear a machine back to the IntvCreate state, leaves the shared CPU tables alone
+
+size_t IntvSerializeSize(intv_machine *m); // largest savestate for the loaded game
+
+size_t IntvSerialize(intv_machine *m, void *data, size_t size); // returns bytes used, 0 if size is too small
+
+int IntvUnserialize(intv_machine *m, const void *data, size_t size); // returns 0 if the state is not for this game or version
 
-extern int intv_halt;
+void SyncAudio(intv_machine *m); // run PSG and Intellivoice up to the current CPU cycle
 
-void LoadGame(const char *path);
+void LoadGame(intv_machine *m, const char *path);
 
-void loadExec(const char *path);
+void loadExec(intv_machine *m, const char *path);
 
-void loadGrom(const char *path);
+void loadGrom(intv_machine *m, const char *path);
 
-void Run(void);
+void Run(intv_machine *m);
 
-void Init(void);
+void Init(intv_machine *m);
 
-void Reset(void);
+void Reset(intv_machine *m);
 
 #endif
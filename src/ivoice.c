@@ -65,27 +65,60 @@
 #include "libretro.h"
 #include "retro_inline.h"
 #include "intv.h"
+#include "machine.h"
 #include "ivoice.h"
 
-#define CONDFREE(p)  if (p) free(p)
+void ivoiceSerialize(intv_machine *m, struct ivoiceSerialized *data)
+{
+    // Everything except the pointers and the scratch buffer
+    memcpy(data->main, &m->intellivoice, sizeof(data->main));
+    data->ivoiceBufferSize = m->ivoiceBufferSize;
+}
+
+void ivoiceUnserialize(intv_machine *m, const struct ivoiceSerialized *data)
+{
+    memcpy(&m->intellivoice, data->main, sizeof(data->main));
+    m->ivoiceBufferSize = data->ivoiceBufferSize;
+}
 
-ivoice_t intellivoice;
-int ivoiceBufferSize;
-int16_t ivoiceBuffer[AUDIO_FREQUENCY / 60 * 2];
+int ivoiceSerializeAudio(intv_machine *m, int16_t *data)
+{
+    ivoice_t *ivoice = &m->intellivoice;
+    uint32_t i;
+    int n = ivoice->cur_len;
+
+    memcpy(data, m->ivoiceBuffer, n * sizeof(int16_t));
+    for (i = ivoice->sc_tail; i != ivoice->sc_head; i++)
+        data[n++] = ivoice->scratch[i & SCBUF_MASK];
+    return n;
+}
 
-void ivoiceSerialize(struct ivoiceSerialized *data)
+int ivoiceCheckAudio(const struct ivoiceSerialized *data, int size)
 {
-    memcpy(&data->main, &intellivoice, sizeof(intellivoice));
-    data->ivoiceBufferSize = ivoiceBufferSize;
-    memcpy(data->ivoiceBuffer, ivoiceBuffer, sizeof(ivoiceBuffer));
+    int      cur_len;
+    uint32_t sc_head, sc_tail;
+
+    memcpy(&cur_len, data->main + offsetof(ivoice_t, cur_len), sizeof(cur_len));
+    memcpy(&sc_head, data->main + offsetof(ivoice_t, sc_head), sizeof(sc_head));
+    memcpy(&sc_tail, data->main + offsetof(ivoice_t, sc_tail), sizeof(sc_tail));
+    if (data->ivoiceBufferSize != AUDIO_FREQUENCY / 60 * 2 ||
+        cur_len < 0 || cur_len > data->ivoiceBufferSize ||
+        sc_head - sc_tail > SCBUF_SIZE ||
+        cur_len + (int)(sc_head - sc_tail) > size)
+        return -1;
+    return cur_len + (int)(sc_head - sc_tail);
 }
 
-void ivoiceUnserialize(const struct ivoiceSerialized *data)
+int ivoiceUnserializeAudio(intv_machine *m, const int16_t *data)
 {
-    // Copies everything except the pointers
-    memcpy(&intellivoice, &data->main, (unsigned char *) &intellivoice.cur_buf - (unsigned char *) &intellivoice);
-    ivoiceBufferSize = data->ivoiceBufferSize;
-    memcpy(ivoiceBuffer, data->ivoiceBuffer, sizeof(ivoiceBuffer));
+    ivoice_t *ivoice = &m->intellivoice;
+    uint32_t i;
+    int n = ivoice->cur_len;
+
+    memcpy(m->ivoiceBuffer, data, n * sizeof(int16_t));
+    for (i = ivoice->sc_tail; i != ivoice->sc_head; i++)
+        ivoice->scratch[i & SCBUF_MASK] = data[n++];
+    return n;
 }
 
 /* ======================================================================== */
@@ -1318,9 +1351,9 @@ static void sp0256_micro(ivoice_t *iv)
 /*  IVOICE_TK    -- Where the magic happens.  Generate voice data for       */
 /*                  our good friend, the Intellivoice.                      */
 /* ======================================================================== */
-uint32_t ivoice_tk(uint32_t len)
+uint32_t ivoice_tk(intv_machine *m, uint32_t len)
 {
-    ivoice_t *ivoice = &intellivoice;
+    ivoice_t *ivoice = &m->intellivoice;
     uint64_t until = (ivoice->now + len) * 4;
     int samples, did_samp, old_idx;
     int sys_clock = ivoice->pal_mode ? 4000000 : 3579545;
@@ -1413,7 +1446,7 @@ uint32_t ivoice_tk(uint32_t len)
                 /* -------------------------------------------------------- */
                 /*  Commit the buffer when it's full.                       */
                 /* -------------------------------------------------------- */
-                if (ivoice->cur_len >= ivoiceBufferSize)
+                if (ivoice->cur_len >= m->ivoiceBufferSize)
                 {
                     ivoice->cur_len = 0;
                 }
@@ -1480,13 +1513,43 @@ uint32_t ivoice_tk(uint32_t len)
     return (ivoice->sound_current >> 2) - (ivoice->now - len);
 }
 
+/* ======================================================================== */
+/*  IVOICE_TK_BATCH -- Advance by len cycles, leaving the sound engine in   */
+/*                     the same state as a run of short ivoice_tk() calls   */
+/*                     covering the same time.  Those drain the scratch     */
+/*                     buffer up to the last sample point before the end,   */
+/*                     so stop there first and tick the remainder.          */
+/* ======================================================================== */
+uint32_t ivoice_tk_batch(intv_machine *m, uint32_t len)
+{
+    ivoice_t *ivoice = &m->intellivoice;
+    uint64_t until = (ivoice->now + len) * 4;
+    uint64_t last;
+    uint32_t first;
+    int clock_per_samp = ivoice->pal_mode ? 400 : 358;
+
+    if (until <= ivoice->sound_current)
+        return ivoice_tk(m, len);
+
+    /* -------------------------------------------------------------------- */
+    /*  Last sample point before 'until', then the cycles that reach it.    */
+    /* -------------------------------------------------------------------- */
+    last  = ivoice->sound_current +
+            (until - ivoice->sound_current - 1) / clock_per_samp
+            * clock_per_samp;
+    first = (uint32_t)(last / 4 - ivoice->now);
+
+    ivoice_tk(m, first);
+    return ivoice_tk(m, len - first);
+}
+
 
 /* ======================================================================== */
 /*  IVOICE_RD    -- Handle reads from the Intellivoice.                     */
 /* ======================================================================== */
-uint32_t ivoice_rd(uint32_t addr)
+uint32_t ivoice_rd(intv_machine *m, uint32_t addr)
 {
-    ivoice_t *ivoice = &intellivoice;
+    ivoice_t *ivoice = &m->intellivoice;
 
     /* -------------------------------------------------------------------- */
     /*  Address 0x80 returns the SP0256 LRQ status on bit 15.               */
@@ -1513,9 +1576,9 @@ uint32_t ivoice_rd(uint32_t addr)
 /* ======================================================================== */
 /*  IVOICE_WR    -- Handle writes to the Intellivoice.                      */
 /* ======================================================================== */
-void ivoice_wr(uint32_t addr, uint32_t data)
+void ivoice_wr(intv_machine *m, uint32_t addr, uint32_t data)
 {
-    ivoice_t *ivoice = &intellivoice;
+    ivoice_t *ivoice = &m->intellivoice;
 
     /* -------------------------------------------------------------------- */
     /*  Ignore writes outside 0x80, 0x81.                                   */
@@ -1598,33 +1661,33 @@ void ivoice_wr(uint32_t addr, uint32_t data)
 /* ======================================================================== */
 /*  IVOICE_RESET -- Resets the Intellivoice                                 */
 /* ======================================================================== */
-void ivoice_reset(void)
+void ivoice_reset(intv_machine *m)
 {
     /* -------------------------------------------------------------------- */
     /*  Do a software-style reset of the Intellivoice.                      */
     /* -------------------------------------------------------------------- */
-    ivoice_wr(1, 0x400);
+    ivoice_wr(m, 1, 0x400);
 }
 
 /* ======================================================================== */
 /*  IVOICE_DTOR  -- Destroy an Intellivoice                                 */
 /* ======================================================================== */
-void ivoice_dtor(void)
+void ivoice_dtor(intv_machine *m)
 {
-    ivoice_t *ivoice = &intellivoice;
-
-    CONDFREE(ivoice->window);
-    CONDFREE(ivoice->scratch);
+    /* -------------------------------------------------------------------- */
+    /*  The window and scratch buffers are part of the machine, which is    */
+    /*  released by IntvDestroy.  Nothing to free here.                     */
+    /* -------------------------------------------------------------------- */
 }
 
-void ivoice_frame(void)
+void ivoice_frame(intv_machine *m)
 {
-    ivoice_t *ivoice = &intellivoice;
+    ivoice_t *ivoice = &m->intellivoice;
     int c;
     
     c = ivoice->cur_len - AUDIO_FREQUENCY / 60;
     if (c > 0)
-        memmove(ivoiceBuffer, ivoiceBuffer + AUDIO_FREQUENCY / 60, c * sizeof(int16_t));
+        memmove(m->ivoiceBuffer, m->ivoiceBuffer + AUDIO_FREQUENCY / 60, c * sizeof(int16_t));
     else
         c = 0;
     ivoice->cur_len = c;
@@ -1635,15 +1698,16 @@ void ivoice_frame(void)
 /* ======================================================================== */
 int ivoice_init
 (
+    intv_machine   *m,
     int             pal_mode,   /*  PAL vs. NTSC                            */
     double          time_scale  /*  For --macho                             */
 )
 {
-    ivoice_t *ivoice = &intellivoice;
+    ivoice_t *ivoice = &m->intellivoice;
     int rate;
     int wind;
     
-    ivoiceBufferSize = AUDIO_FREQUENCY / 60 * 2;
+    m->ivoiceBufferSize = AUDIO_FREQUENCY / 60 * 2;
     rate = AUDIO_FREQUENCY;   /* Sampling rate */
     wind = -1;  /* Sliding window size */
     
@@ -1695,7 +1759,7 @@ int ivoice_init
     /* -------------------------------------------------------------------- */
     /*  Set up our initial working buffer.                                  */
     /* -------------------------------------------------------------------- */
-    ivoice->cur_buf = ivoiceBuffer;
+    ivoice->cur_buf = m->ivoiceBuffer;
     ivoice->cur_len = 0;
 
     /* -------------------------------------------------------------------- */
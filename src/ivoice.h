@@ -9,6 +9,9 @@
 #ifndef IVOICE_H_
 #define IVOICE_H_
 
+#include <stddef.h>
+#include "intv.h"
+
 #define SCBUF_SIZE   (4096)             /* Must be power of 2               */
 #define SCBUF_MASK   (SCBUF_SIZE - 1)
 
@@ -31,7 +34,6 @@ typedef struct ivoice_t
 
     int         silent;     /* Flag:  Intellivoice is silent.               */
 
-    int16_t     scratch[SCBUF_SIZE];    /* Scratch buffer for audio.        */
     uint32_t    sc_head;    /* Head/Tail pointer into scratch circular buf  */
     uint32_t    sc_tail;    /* Head/Tail pointer into scratch circular buf  */
     uint64_t    sound_current;
@@ -63,36 +65,44 @@ typedef struct ivoice_t
     int         cur_len;    /* Fullness of current sound buffer.            */
     int16_t    *cur_buf;    /* Current sound buffer.                        */
     const uint8_t *rom[16]; /* 4K ROM pages.                                */
+
+    int16_t     scratch[SCBUF_SIZE];    /* Scratch buffer for audio.        */
 } ivoice_t;
 
 struct ivoiceSerialized {
-    ivoice_t main;
+    unsigned char main[offsetof(ivoice_t, cur_buf)]; /* up to the pointers */
     int ivoiceBufferSize;
-    int16_t ivoiceBuffer[AUDIO_FREQUENCY / 60 * 2];
 };
 
-void ivoiceSerialize(struct ivoiceSerialized *);
-void ivoiceUnserialize(const struct ivoiceSerialized *);
-
-uint32_t ivoice_tk(uint32_t);
-uint32_t ivoice_rd(uint32_t);
-void ivoice_wr(uint32_t, uint32_t);
-void ivoice_reset(void);
-void ivoice_dtor(void);
-void ivoice_frame(void);
+void ivoiceSerialize(intv_machine *, struct ivoiceSerialized *);
+void ivoiceUnserialize(intv_machine *, const struct ivoiceSerialized *);
+
+/* Samples not played yet (ivoiceBuffer, then the live part of scratch).   */
+/* Check returns -1 if the samples saved with a state don't fit in 'size'  */
+/* words, else the number of words.  Unserialize goes after a successful   */
+/* check and ivoiceUnserialize, and returns the number of words used.      */
+int ivoiceSerializeAudio(intv_machine *, int16_t *);
+int ivoiceCheckAudio(const struct ivoiceSerialized *, int size);
+int ivoiceUnserializeAudio(intv_machine *, const int16_t *);
+
+uint32_t ivoice_tk(intv_machine *, uint32_t);
+uint32_t ivoice_tk_batch(intv_machine *, uint32_t);
+uint32_t ivoice_rd(intv_machine *, uint32_t);
+void ivoice_wr(intv_machine *, uint32_t, uint32_t);
+void ivoice_reset(intv_machine *);
+void ivoice_dtor(intv_machine *);
+void ivoice_frame(intv_machine *);
 
 /* ======================================================================== */
 /*  IVOICE_INIT  -- Makes a new Intellivoice                                */
 /* ======================================================================== */
 int ivoice_init
 (
+    intv_machine   *m,
     int             pal_mode,
     double          time_scale
 );
 
-extern int ivoiceBufferSize;
-extern int16_t ivoiceBuffer[];
-
 #endif
 /* ======================================================================== */
 /*  This program is free software; you can redistribute it and/or modify    */
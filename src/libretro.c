@@ -29,6 +29,7 @@
 #include <vfs/vfs_implementation.h>
 
 #include "intv.h"
+#include "machine.h"
 #include "cp1610.h"
 #include "memory.h"
 #include "stic.h"
@@ -36,6 +37,10 @@
 #include "ivoice.h"
 #include "controller.h"
 #include "osd.h"
+#include "profile.h"
+#include "trace.h"
+#include "rewind.h"
+#include "movie.h"
 
 // Include stb_image header (implementation in stb_image_impl.c)
 #include "stb_image.h"
@@ -48,8 +53,12 @@
 #define DefaultFPS 60
 #define MaxWidth 352
 #define MaxHeight 224
+#define NativeWidth 176
 #define MAX_PADS 2
 
+intv_machine *Machine = NULL; // the console run by this core
+unsigned int frameRGB[MaxWidth * MaxHeight]; // Machine->frame in colors, overlays and OSD draw here
+
 // ========================================
 // HORIZONTAL LAYOUT DISPLAY CONFIGURATION
 // ========================================
@@ -91,6 +100,20 @@ static const int GAME_WIDTH = 352;
 static const int GAME_HEIGHT = 224;
 static int display_swap = 0;  // 0 = game left/keypad right, 1 = game right/keypad left
 
+// Native resolution video: frames go out at 176x112 (176x224 with half-height
+// MOBs), frameRGB is only filled when the OSD or an overlay is shown
+static int native_video_enabled = 0;  // Default to disabled - enable via core option
+static unsigned int native_buffer[NativeWidth * MaxHeight];
+static int native_height = MaxHeight / 2;
+static bool frame_rgb_stale = false;
+
+// Frame duping: a frame[] the STIC did not draw again goes out as NULL when
+// the last frame sent was the game picture alone
+static bool libretro_supports_dupe = false;
+static bool shown_plain = false;       // last frame sent had no OSD or overlay
+static unsigned int shown_version = 0; // Machine->frameVersion it showed
+static bool video_skipped = false;     // the frontend dropped the last frame
+
 // Hotspot input tracking
 static int hotspot_pressed[OVERLAY_HOTSPOT_COUNT] = {0};  // Track which hotspots are currently pressed
 
@@ -378,7 +401,6 @@ static void render_multi_screen(void)
 {
     int i, y, x;
     unsigned int* multi_buffer;
-    extern unsigned int frame[352 * 224];
     int game_x_offset, keypad_x_offset;
     int util_bg_x1, util_bg_x2, util_bg_y1, util_bg_y2;
     int src_y, src_x, workspace_x, workspace_y;
@@ -456,7 +478,7 @@ static void render_multi_screen(void)
             if (workspace_x >= WORKSPACE_WIDTH) continue;
             
             if (src_y < GAME_HEIGHT && src_x < GAME_WIDTH) {
-                multi_buffer[y * WORKSPACE_WIDTH + workspace_x] = frame[src_y * GAME_WIDTH + src_x];
+                multi_buffer[y * WORKSPACE_WIDTH + workspace_x] = frameRGB[src_y * GAME_WIDTH + src_x];
             } else {
                 multi_buffer[y * WORKSPACE_WIDTH + workspace_x] = 0xFF000000;
             }
@@ -913,7 +935,7 @@ static void process_hotspot_input(void)
     // Send hotspot input directly to controller 0 (player 1)
     if (hotspot_input)
     {
-        setControllerInput(0, hotspot_input);
+        setControllerInput(Machine, 0, hotspot_input);
     }
 }
 
@@ -933,6 +955,14 @@ bool keyboardChange = false;
 bool keyboardDown = false;
 int  keyboardState = 0;
 
+rewind_buffer *Rewind = NULL; // core-side rewind history, NULL when disabled
+size_t rewindBudget = 0;
+bool rewindHeld = false; // Backspace held
+
+intv_movie *Movie = NULL; // input movie being recorded, NULL when off
+bool movieEnabled = false;
+char moviePath[PATH_MAX_LENGTH];
+
 // at 44.1khz, read 735 samples (44100/60) 
 // at 48khz, read 800 samples (48000/60)
 // e.g. audioInc = 3733.5 / 735
@@ -950,14 +980,19 @@ unsigned int frameSize =  MaxWidth * MaxHeight; //78848
 
 void quit(int state)
 {
-	Reset();
-	MemoryInit();
+	Reset(Machine);
+	MemoryInit(Machine);
 }
 
 static void Keyboard(bool down, unsigned keycode,
       uint32_t character, uint16_t key_modifiers)
 {
 	/* Keyboard Input */
+	if (keycode == RETROK_BACKSPACE) // hold to rewind
+	{
+		rewindHeld = down;
+		return;
+	}
 	keyboardDown = down;
 	keyboardChange = true; 
 	switch (character)
@@ -1061,6 +1096,65 @@ static void update_input(void)
 	joypad1[17] = InputState(1, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_RIGHT, RETRO_DEVICE_ID_ANALOG_Y);
 }
 
+// Profiler and trace output goes next to the save files
+static void debug_path(char *path, const char *name)
+{
+	const char *dir = NULL;
+
+	if (!Environ(RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY, &dir) || !dir)
+		dir = SystemPath;
+	fill_pathname_join(path, dir, name, PATH_MAX_LENGTH);
+}
+
+// freeintv_profile.txt/.csv
+static void dump_profile(void)
+{
+	char profilePath[PATH_MAX_LENGTH];
+
+	debug_path(profilePath, "freeintv_profile");
+	ProfileDump(profilePath);
+}
+
+// freeintv_trace.bin, decode with tools/trace2jzintv
+static void dump_trace(void)
+{
+	char tracePath[PATH_MAX_LENGTH];
+
+	debug_path(tracePath, "freeintv_trace.bin");
+	TraceDump(tracePath);
+}
+
+// <rom>.fimv, recorded from loading the game up to now
+static void finish_movie(void)
+{
+	if (Movie == NULL)
+		return;
+	MovieSave(Movie, moviePath);
+	MovieDestroy(Movie);
+	Movie = NULL;
+}
+
+// Machine->frame was drawn again
+static void new_frame(void)
+{
+	if (native_video_enabled && !multi_screen_enabled)
+	{
+		native_height = STICFrameToNative(Machine, native_buffer);
+		frame_rgb_stale = true;
+	}
+	else
+		STICFrameToRGB(Machine, frameRGB);
+}
+
+// Brings frameRGB up to date before drawing over it
+static void frame_rgb(void)
+{
+	if (!frame_rgb_stale)
+		return;
+	STICFrameToRGB(Machine, frameRGB);
+	frame_rgb_stale = false;
+}
+
 static void check_variables(bool first_run)
 {
 	struct retro_variable var = {0};
@@ -1090,6 +1184,89 @@ static void check_variables(bool first_run)
 			if (strcmp(var.value, "enabled") == 0)
 				multi_screen_enabled = 1;
 		}
+
+		// Check native resolution option
+		var.key   = "freeintv_native_video";
+		var.value = NULL;
+		native_video_enabled = 0;
+
+		if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+		{
+			if (strcmp(var.value, "enabled") == 0)
+				native_video_enabled = 1;
+		}
+	}
+
+	var.key   = "freeintv_cpu_cache";
+	var.value = NULL;
+
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		if (strcmp(var.value, "disabled") == 0)
+			CP1610SetCache(Machine, 0);
+		else if (strcmp(var.value, "enabled") == 0)
+			CP1610SetCache(Machine, 2);
+		else
+			CP1610SetCache(Machine, 1);
+	}
+
+	var.key   = "freeintv_render_thread";
+	var.value = NULL;
+
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		if (strcmp(var.value, "enabled") == 0)
+			STICThreadStart(Machine);
+		else
+			STICThreadStop(Machine);
+	}
+
+	var.key   = "freeintv_profiler";
+	var.value = NULL;
+
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		// switching the profiler off writes the report
+		if (ProfileEnabled && strcmp(var.value, "enabled") != 0)
+			dump_profile();
+		ProfileSetEnabled(strcmp(var.value, "enabled") == 0);
+	}
+
+	var.key   = "freeintv_trace";
+	var.value = NULL;
+
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		// switching the trace off writes the ring
+		if (TraceEnabled && strcmp(var.value, "enabled") != 0)
+			dump_trace();
+		TraceSetEnabled(strcmp(var.value, "enabled") == 0);
+	}
+
+	var.key   = "freeintv_rewind";
+	var.value = NULL;
+
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		size_t budget = strcmp(var.value, "disabled") == 0 ? 0 : (size_t) atoi(var.value) << 20;
+
+		if (budget != rewindBudget)
+		{
+			RewindDestroy(Rewind);
+			Rewind = budget ? RewindCreate(budget) : NULL;
+			rewindBudget = budget;
+		}
+	}
+
+	var.key   = "freeintv_movie";
+	var.value = NULL;
+
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		// switching it off writes the movie, switching it on records from the next game load
+		movieEnabled = strcmp(var.value, "enabled") == 0;
+		if (!movieEnabled)
+			finish_movie();
 	}
 }
 
@@ -1159,28 +1336,29 @@ void retro_init(void)
 	};
 
 	// init buffers, structs
-	memset(frame, 0, frameSize);
-	OSD_setDisplay(frame, MaxWidth, MaxHeight);
+	IntvInitTables();
+	Machine = IntvCreate();
+	memset(frameRGB, 0, sizeof(frameRGB));
+	OSD_setDisplay(frameRGB, MaxWidth, MaxHeight);
 
 	Environ(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
 
 	if (Environ(RETRO_ENVIRONMENT_GET_INPUT_BITMASKS, NULL))
 		libretro_supports_bitmasks = true;
 
-	// reset console
-	Init();
-	Reset();
+	if (!Environ(RETRO_ENVIRONMENT_GET_CAN_DUPE, &libretro_supports_dupe))
+		libretro_supports_dupe = false;
 
 	// get paths
 	Environ(RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY, &SystemPath);
 
 	// load exec
 	fill_pathname_join(execPath, SystemPath, "exec.bin", PATH_MAX_LENGTH);
-	loadExec(execPath);
+	loadExec(Machine, execPath);
 
 	// load grom
 	fill_pathname_join(gromPath, SystemPath, "grom.bin", PATH_MAX_LENGTH);
-	loadGrom(gromPath);
+	loadGrom(Machine, gromPath);
 
 	// Setup keyboard input
 	Environ(RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK, &kb);
@@ -1189,7 +1367,20 @@ void retro_init(void)
 	bool retro_load_game(const struct retro_game_info *info)
 	{
 		check_variables(true);
-		LoadGame(info->path);
+		LoadGame(Machine, info->path);
+		if (Rewind != NULL)
+			RewindClear(Rewind);
+		finish_movie();
+		if (movieEnabled)
+		{
+			char base[PATH_MAX_LENGTH];
+			char name[PATH_MAX_LENGTH];
+
+			fill_pathname_base(base, info->path, sizeof(base));
+			fill_pathname(name, base, ".fimv", sizeof(name));
+			debug_path(moviePath, name);
+			Movie = MovieCreate(Machine, MOVIE_HASH_INTERVAL);
+		}
 		
 		// Load embedded asset images (controller base, banner, overlay)
 		load_controller_base();
@@ -1200,6 +1391,11 @@ void retro_init(void)
 
 void retro_unload_game(void)
 {
+	finish_movie();
+	if (ProfileEnabled)
+		dump_profile();
+	if (TraceEnabled)
+		dump_trace();
 	quit(0);
 }
 
@@ -1216,6 +1412,10 @@ void retro_run(void)
 	FILE *f;
 	int any_hotspot_pressed;
 	int h;
+	int av_enable;
+	bool overlay = false;
+	bool plain;
+	bool dupe;
 	
 	showKeypad0 = false;
 	showKeypad1 = false;
@@ -1231,6 +1431,7 @@ void retro_run(void)
 		paused = !paused;
 		if(paused)
 		{
+			frame_rgb();
 			OSD_drawPaused();
 			OSD_drawTextCenterBG(21, "HELP - PRESS A");
 		}
@@ -1258,6 +1459,17 @@ void retro_run(void)
 			OSD_drawTextBG(3, 18, "                                      ");
 		}
 	}
+	else if (rewindHeld && Rewind != NULL && RewindStep(Rewind, Machine))
+	{
+		// the restored state brings its frame back, the sound stays quiet
+		new_frame();
+		if (Movie != NULL)
+			MovieStepBack(Movie);
+		for(i=0; i<audioSamples; i++)
+		{
+			Audio(0, 0);
+		}
+	}
 	else
 	{
 		// SINGLE-SCREEN MODE: Use original FreeIntv keypad popup behavior
@@ -1267,24 +1479,24 @@ void retro_run(void)
 			if(joypad0[10] | joypad0[11]) // left/right shoulder down
 			{
 				showKeypad0 = true;
-				setControllerInput(0, getKeypadState(0, joypad0, joypre0));
+				setControllerInput(Machine, 0, getKeypadState(0, joypad0, joypre0));
 			}
 			else
 			{
 				showKeypad0 = false;
-				setControllerInput(0, getControllerState(joypad0, 0));
+				setControllerInput(Machine, 0, getControllerState(joypad0, 0));
 			}
 
 			// Player 2: L/R button shows keypad overlay
 			if(joypad1[10] | joypad1[11]) // left/right shoulder down
 			{
 				showKeypad1 = true;
-				setControllerInput(1, getKeypadState(1, joypad1, joypre1));
+				setControllerInput(Machine, 1, getKeypadState(1, joypad1, joypre1));
 			}
 			else
 			{
 				showKeypad1 = false;
-				setControllerInput(1, getControllerState(joypad1, 1));
+				setControllerInput(Machine, 1, getControllerState(joypad1, 1));
 			}
 		}
 		// MULTI-SCREEN MODE: Use overlay hotspot system
@@ -1311,34 +1523,51 @@ void retro_run(void)
 			// If no hotspots pressed, handle regular controller input
 			if (!any_hotspot_pressed)
 			{
-				setControllerInput(0, getControllerState(joypad0, 0));
+				setControllerInput(Machine, 0, getControllerState(joypad0, 0));
 			}
 
 			// Player 2 controller input (unchanged - no hotspot overlay for player 2)
 			if(joypad1[10] | joypad1[11]) // left shoulder down
 			{
 				showKeypad1 = true;
-				setControllerInput(1, getKeypadState(1, joypad1, joypre1));
+				setControllerInput(Machine, 1, getKeypadState(1, joypad1, joypre1));
 			}
 			else
 			{
 				showKeypad1 = false;
-				setControllerInput(1, getControllerState(joypad1, 1));
+				setControllerInput(Machine, 1, getControllerState(joypad1, 1));
 			}
 		}
 
 		if(keyboardDown || keyboardChange)
 		{
-			setControllerInput(0, keyboardState);
+			setControllerInput(Machine, 0, keyboardState);
 			keyboardChange = false;
 		}
 
+		// frame skip and fast-forward: frames the frontend drops only need collisions
+		Machine->SkipVideo = Environ(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable) && !(av_enable & 1);
+
+		if (Movie != NULL)
+			MovieInput(Movie, Machine);
+
 		// grab frame
-		Run();
+		Run(Machine);
+		// with the render thread the frame is shown one frame late, but after
+		// skipped frames frame[] still holds the one before them: wait for it
+		if (!Machine->SkipVideo && video_skipped)
+			STICFinishFrame(Machine);
+		video_skipped = Machine->SkipVideo;
+		if (!Machine->SkipVideo && (!shown_plain || Machine->frameVersion != shown_version))
+			new_frame();
+
+		if (Movie != NULL)
+			MovieCheck(Movie, Machine);
 
 		// draw overlays
-		if(showKeypad0) { drawMiniKeypad(0, frame); }
-		if(showKeypad1) { drawMiniKeypad(1, frame); }
+		if(showKeypad0 || showKeypad1) { frame_rgb(); overlay = true; }
+		if(showKeypad0) { drawMiniKeypad(0, frameRGB); }
+		if(showKeypad1) { drawMiniKeypad(1, frameRGB); }
 
 		// sample audio from buffer
 		audioInc = 3733.5 / audioSamples;
@@ -1358,25 +1587,28 @@ void retro_run(void)
 
 			c = 0;
 			while (j < k)
-				c += PSGBuffer[j++];
+				c += Machine->PSGBuffer[j++];
 			c = c / l;
 			// Finally it adds the Intellivoice output (properly generated at the
 			// same frequency as output)
-			c = (c + ivoiceBuffer[(int) ivoiceBufferPos]) / 2;
+			c = (c + Machine->ivoiceBuffer[(int) ivoiceBufferPos]) / 2;
 
 			Audio(c, c); // Audio(left, right)
 
 			ivoiceBufferPos += ivoiceInc;
 
-			if (ivoiceBufferPos >= ivoiceBufferSize)
+			if (ivoiceBufferPos >= Machine->ivoiceBufferSize)
 				ivoiceBufferPos = 0.0;
 
-			audioBufferPos = audioBufferPos * (audioBufferPos<(PSGBufferSize-1));
+			audioBufferPos = audioBufferPos * (audioBufferPos<(Machine->PSGBufferSize-1));
 		}
 		audioBufferPos = 0.0;
-		PSGFrame();
+		PSGFrame(Machine);
 		ivoiceBufferPos = 0.0;
-		ivoice_frame();
+		ivoice_frame(Machine);
+
+		if (Rewind != NULL)
+			RewindPush(Rewind, Machine);
 	}
 
 	// Swap Left/Right Controller
@@ -1386,6 +1618,8 @@ void retro_run(void)
 		{
 			controllerSwap = controllerSwap ^ 1;
 		}
+		frame_rgb();
+		overlay = true;
 		if(controllerSwap==1)
 		{
 			OSD_drawLeftRight();
@@ -1396,17 +1630,37 @@ void retro_run(void)
 		}
 	}
 
-	if (intv_halt)
+	if (Machine->intv_halt)
+	{
+		frame_rgb();
+		overlay = true;
 		OSD_drawTextBG(3, 5, "INTELLIVISION HALTED");
+		// keep the instructions leading to the halt
+		if (TraceEnabled)
+		{
+			dump_trace();
+			TraceSetEnabled(0);
+		}
+	}
 	
 	// Render multi-screen display (game + keypad)
 	render_multi_screen();
 	
+	// Unchanged game picture, the frontend shows the last frame again
+	plain = !overlay && !paused && !(multi_screen_enabled && multi_screen_buffer);
+	dupe = plain && shown_plain && libretro_supports_dupe && Machine->frameVersion == shown_version;
+	shown_plain = plain;
+	shown_version = Machine->frameVersion;
+
 	// Send frame to libretro
 	if (multi_screen_enabled && multi_screen_buffer) {
 		Video(multi_screen_buffer, WORKSPACE_WIDTH, WORKSPACE_HEIGHT, sizeof(unsigned int) * WORKSPACE_WIDTH);
+	} else if (native_video_enabled && !overlay && !paused) {
+		Video(dupe ? NULL : native_buffer, NativeWidth, native_height, sizeof(unsigned int) * NativeWidth);
 	} else {
-		Video(frame, frameWidth, frameHeight, sizeof(unsigned int) * frameWidth);
+		// the OSD and the keypad are drawn at 352x224
+		frame_rgb();
+		Video(dupe ? NULL : frameRGB, frameWidth, frameHeight, sizeof(unsigned int) * frameWidth);
 	}
 
 }
@@ -1441,6 +1695,13 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
 		info->geometry.max_width    = WORKSPACE_WIDTH;
 		info->geometry.max_height   = WORKSPACE_HEIGHT;
 		info->geometry.aspect_ratio = ((float)WORKSPACE_WIDTH) / ((float)WORKSPACE_HEIGHT);
+	} else if (native_video_enabled) {
+		// frames with the OSD on top still come at 352x224
+		info->geometry.base_width   = NativeWidth;
+		info->geometry.base_height  = MaxHeight / 2;
+		info->geometry.max_width    = MaxWidth;
+		info->geometry.max_height   = MaxHeight;
+		info->geometry.aspect_ratio = ((float)MaxWidth) / ((float)MaxHeight);
 	} else {
 		info->geometry.base_width   = MaxWidth;
 		info->geometry.base_height  = MaxHeight;
@@ -1460,20 +1721,30 @@ void retro_deinit(void)
 {
 	libretro_supports_bitmasks = false;
 	libretro_supports_option_categories = false;
+	libretro_supports_dupe = false;
+	shown_plain = false;
 	quit(0);
+	finish_movie();
+	RewindDestroy(Rewind);
+	Rewind = NULL;
+	rewindBudget = 0;
+	IntvDestroy(Machine);
+	Machine = NULL;
 }
 
 void retro_reset(void)
 {
 	// Reset (from intv.c) //
-	Reset();
+	Reset(Machine);
+	if (Movie != NULL)
+		MovieReset(Movie);
 }
 
 RETRO_API void *retro_get_memory_data(unsigned id)
 {
 	if(id==RETRO_MEMORY_SYSTEM_RAM)
 	{
-		return Memory;
+		return Machine->Memory;
 	}
 	return 0;
 }
@@ -1487,55 +1758,23 @@ RETRO_API size_t retro_get_memory_size(unsigned id)
 	return 0;
 }
 
-#define SERIALIZED_VERSION 0x4f544702
-
-struct serialized {
-	int version;
-	struct CP1610serialized CP1610;
-	struct STICserialized STIC;
-	struct PSGserialized PSG;
-	struct ivoiceSerialized ivoice;
-	unsigned int Memory[0x10000];   // Should be equal to Memory.c
-	// Extra variables from intv.c
-	int SR1;
-	int intv_halt;
-};
-
 size_t retro_serialize_size(void)
 {
-	return sizeof(struct serialized);
+	return IntvSerializeSize(Machine);
 }
 
 bool retro_serialize(void *data, size_t size)
 {
-	struct serialized *all;
-
-	all = (struct serialized *) data;
-	all->version = SERIALIZED_VERSION;
-	CP1610Serialize(&all->CP1610);
-	STICSerialize(&all->STIC);
-	PSGSerialize(&all->PSG);
-	ivoiceSerialize(&all->ivoice);
-	memcpy(all->Memory, Memory, sizeof(Memory));
-	all->SR1 = SR1;
-	all->intv_halt = intv_halt;
-	return true;
+	return IntvSerialize(Machine, data, size) != 0;
 }
 
 bool retro_unserialize(const void *data, size_t size)
 {
-	const struct serialized *all;
-
-	all = (const struct serialized *) data;
-	if (all->version != SERIALIZED_VERSION)
+	if (!IntvUnserialize(Machine, data, size))
 		return false;
-	CP1610Unserialize(&all->CP1610);
-	STICUnserialize(&all->STIC);
-	PSGUnserialize(&all->PSG);
-	ivoiceUnserialize(&all->ivoice);
-	memcpy(Memory, all->Memory, sizeof(Memory));
-	SR1 = all->SR1;
-	intv_halt = all->intv_halt;
+	new_frame();
+	// the movie can't follow the jump, it ends here
+	finish_movie();
 	return true;
 }
 
@@ -60,6 +60,11 @@ struct retro_core_option_v2_category option_cats_us[] = {
       "Display",
       "Change display settings."
    },
+   {
+      "system",
+      "System",
+      "Change emulation settings."
+   },
    { NULL, NULL, NULL },
 };
 
@@ -92,6 +97,110 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled"
    },
+   {
+      "freeintv_native_video",
+      "Native Resolution Video (Restart Required)",
+      NULL,
+      "Output 176x112 frames, one pixel per STIC pixel, and leave scaling to the frontend. Frames with half-height moving objects are 176x224, and frames with the on-screen menus or keypad are 352x224. Has no effect with the keypad overlays enabled. Changing this setting requires a core restart.",
+      NULL,
+      "display",
+      {
+         { "disabled", "Disabled" },
+         { "enabled",  "Enabled"  },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "freeintv_cpu_cache",
+      "CPU Instruction Cache",
+      NULL,
+      "Keep decoded CP-1610 instructions for ROM and RAM code instead of fetching and decoding every instruction again. 'Compiled Blocks' also compiles straight-line code to native x86-64 code; on other systems, or when the core can't map executable memory, it falls back to the decode cache. Disable to use the plain interpreter when investigating emulation issues.",
+      NULL,
+      "system",
+      {
+         { "decode",   "Decode Cache" },
+         { "enabled",  "Compiled Blocks" },
+         { "disabled", "Disabled" },
+         { NULL, NULL },
+      },
+      "decode"
+   },
+   {
+      "freeintv_render_thread",
+      "Threaded Video",
+      NULL,
+      "Draw each frame on a second thread while the CPU emulation runs on. Frames are shown one frame later. Collisions are not affected. Rewind and movie recording wait for the frame they save, so they take back most of the gain.",
+      NULL,
+      "system",
+      {
+         { "disabled", "Disabled" },
+         { "enabled",  "Enabled"  },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "freeintv_profiler",
+      "CPU Profiler",
+      NULL,
+      "Count CP-1610 instructions and cycles per address and per mnemonic. The report (freeintv_profile.txt, sorted) and a per-address table (freeintv_profile.csv) are written to the save directory when the profiler is switched off or the game is closed.",
+      NULL,
+      "system",
+      {
+         { "disabled", "Disabled" },
+         { "enabled",  "Enabled"  },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "freeintv_trace",
+      "CPU Execution Trace",
+      NULL,
+      "Record the last 65536 CP-1610 instructions with registers, flags and cycle counts. The trace is written to freeintv_trace.bin in the save directory when it is switched off, the game is closed or the CPU halts. tools/trace2jzintv turns it into jzIntv debugger text.",
+      NULL,
+      "system",
+      {
+         { "disabled", "Disabled" },
+         { "enabled",  "Enabled"  },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "freeintv_rewind",
+      "Rewind Buffer",
+      NULL,
+      "Keep a history of past frames in the core, stored as compressed differences between frames. Hold Backspace on the keyboard to step back. Sets the memory for the history; more memory keeps more seconds.",
+      NULL,
+      "system",
+      {
+         { "disabled", "Disabled" },
+         { "1",        "1 MB"     },
+         { "2",        "2 MB"     },
+         { "4",        "4 MB"     },
+         { "8",        "8 MB"     },
+         { "16",       "16 MB"    },
+         { "32",       "32 MB"    },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "freeintv_movie",
+      "Record Input Movie",
+      NULL,
+      "Record the controllers from the next game load on, with periodic hashes of the emulated machine, to <rom>.fimv in the save directory. The movie is written when it is switched off, the game is closed or a state is loaded. tools/movie.c replays it headless to check that a build still emulates the session exactly.",
+      NULL,
+      "system",
+      {
+         { "disabled", "Disabled" },
+         { "enabled",  "Enabled"  },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
    { NULL, NULL, NULL, NULL, NULL, NULL, {{0}}, NULL },
 };
 
@@ -0,0 +1,193 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef MACHINE_H
+#define MACHINE_H
+
+// The complete state of one Intellivision.  Every subsystem takes the
+// machine as its first argument, so a process can run any number of
+// them, each on its own thread.  Only the tables built once by
+// IntvInitTables and the frontend state (OSD, controller swap, profiler
+// and trace) are shared.
+
+#include <stdint.h>
+#include "intv.h"
+#include "cp1610.h"
+#include "ivoice.h"
+
+// What the STIC draws a frame from.  The Memory copies are also the key
+// unchanged frames are recognized by; $18-$1F only collect collisions.
+struct STICinput
+{
+	unsigned int mode;          // STICMode
+	unsigned int enabled;       // display enable
+	unsigned int mob[0x18];     // $00-$17 MOB registers
+	unsigned int stack[0x0B];   // $28-$32 color stack, border color, delays
+	unsigned int backtab[0xF0]; // $200-$2EF
+	unsigned int cards[0xA00];  // $3000-$39FF GROM and GRAM
+	int delayH; // from stack[], see frameDelays
+	int delayV;
+	int extendTop;
+	int extendLeft;
+};
+
+// Scratch state of drawing a frame from a STICinput
+struct STICrender
+{
+	unsigned int CSP; // Color Stack Pointer
+	uint8_t fgcard[20]; // cached colors for cards on current row
+	uint8_t bgcard[20]; // (used for normal color stack mode)
+	uint8_t scanBuffer[384]; // buffer for current scanline, two lines of (176+16), colors[] indices
+	uint64_t collMask[10][2][4]; // per line pixel masks of MOBs 0-7, background (8) and border (9), bit 0 is column 0 -- one word larger than needed to save checks
+	unsigned int coll[8]; // $18-$1F bits of the rows drawn
+};
+
+// Predecoded instruction cache entry, see cp1610.c
+struct decoded
+{
+	int (*op)(intv_machine *, int); // handler (NULL = entry not decoded)
+	unsigned short instruction;
+	unsigned short operand; // first operand word (Jump: return register)
+	unsigned short adr;     // Jump target address
+	unsigned short flags;   // Jump interrupt flag (0-no change, 1-set, 2-clear)
+};
+
+struct intv_machine
+{
+	// CP1610
+	unsigned int R[8]; // Registers R0-R7
+
+	int InstructionRegister; // four external lines?
+
+	int Flag_DoubleByteData;
+	int Flag_InteruptEnable;
+
+	// Condition flags are kept in the form the ALU produced them, so setting
+	// them is a plain store and the bits are only extracted when read:
+	//   Sign     = FlagSZ bit 15 or 16    Zero     = FlagSZ bits 0-15 all clear
+	//   Carry    = FlagC bit 16           Overflow = FlagO bit 15
+	int FlagSZ;
+	int FlagC;
+	int FlagO;
+
+	const struct decoded *Current; // cache entry of the executing instruction
+
+	int CacheEnabled; // 0 = fetch every instruction through readMem and OpCodes[]
+	struct CP1610jit *Jit; // compiled blocks when CacheEnabled is 2, NULL = none
+
+	// System
+	int SR1; // SR1 line for interrupt
+	int intv_halt;
+
+	int pending_ticks; // CPU cycles not yet run on the PSG and Intellivoice
+
+	unsigned int idle_pc; // target of the last backward jump
+	int idle_ticks;       // cycles run since then
+	unsigned int idle_events; // mem_events at idle_pc
+	struct CP1610serialized idle_cpu;
+
+	// Memory map, one entry per 256-word page
+	unsigned int *ReadPage[256];
+	unsigned int *WritePage[256];
+	int (*ReadHandler[256])(intv_machine *m, int adr);
+	void (*WriteHandler[256])(intv_machine *m, int adr, int val);
+
+	int d000_ram; // 1 = $D000-$D3FF is 8-bit RAM (e.g. USCF Chess)
+
+	unsigned int mem_events; // bumped on every write and every read with side effects (idle loop detection)
+
+	uint32_t DirtyPages[8]; // one bit per page of Memory written since the last MemoryDirtyPages call
+
+	// STIC
+	unsigned int STICMode; // 0-foreground/background, 1-color stack/color squares
+
+	int stic_phase;
+	int stic_vid_enable;
+	int stic_reg;
+	int stic_gram;
+	int phase_len;
+
+	int DisplayEnabled; // determines if frame should be updated or not
+	int SkipVideo; // set by the frontend when it won't show the next frame, only collisions are computed
+
+	int delayH; // Horizontal Delay
+	int delayV; // Vertical Delay
+
+	int extendTop;
+	int extendLeft;
+
+	// frame[] was drawn from frameInput, while it holds the frame is not
+	// drawn again and render.coll is latched as drawing it did
+	struct STICinput frameInput;
+	int frameKeyValid;
+	struct STICrender render;
+	unsigned int frameVersion; // bumped each time frame[] is drawn
+	struct STICworker *STICWorker; // render thread, NULL draws frames in exec (see STICThreadStart)
+
+	// PSG
+	int Ticks; // CPU cycles not yet processed
+
+	int CountA; // countdowns for tone generators
+	int CountB; // used to modulate square-wave
+	int CountC; // according to Channel Period
+	int CountN; // countdown for noise generator
+	int CountE; // countdown for envelope generator
+
+	int OutA; // outputs for each tone generator
+	int OutB;
+	int OutC;
+	int OutN;  // Noise generator output
+	int OutE;  // Envelope generator output
+
+	int ChA; // Channel Period from PSG Registers
+	int ChB;
+	int ChC;
+
+	int NoiseP; // Noise Period
+
+	int EnvP;    // Envelope Period
+	int StepE; // 1, 0, -1 -- Direction to Step Envelope at end of countdown
+
+	int EnvContinue; // Flags from Envelope Type
+	int EnvAttack;
+	int EnvAlternate;
+	int EnvHold;
+
+	// Circular Buffer holds up to two frames:
+	int PSGBufferSize;
+	int PSGBufferPos; // points to next location in output buffer
+	int16_t PSGBuffer[7467]; // 14934 cpu cycles/frame ; 3733.5 psg cycles/frame
+
+	// Intellivoice
+	ivoice_t intellivoice;
+	int ivoiceBufferSize;
+	int16_t ivoiceBuffer[AUDIO_FREQUENCY / 60 * 2];
+
+	// Cartridge image
+	int cart_data[0x20000]; // rom data loaded from file
+	int cart_size; // size of file read
+	int cart_pos; // current position in data
+	int cart_map; // memory map from the cart database, -1 if not looked up or no match
+
+	unsigned int Memory[0x10000];
+
+	uint8_t frame[176*224]; // frame buffer, colors[] indices, 2 lines per row (see STICFrameToRGB)
+
+	struct decoded Decoded[0x10000];
+};
+
+#endif
@@ -16,16 +16,15 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include <stdio.h>
+#include <string.h>
 
 #include "intv.h"
+#include "machine.h"
 #include "memory.h"
 #include "stic.h"
 #include "psg.h"
 #include "ivoice.h"
-
-unsigned int Memory[0x10000];
-
-int d000_ram = 0; /* 1 = $D000-$D3FF is 8-bit RAM (e.g. USCF Chess) */
+#include "cp1610.h"
 
 int stic_and[64] = {
     0x07ff, 0x07ff, 0x07ff, 0x07ff, 0x07ff, 0x07ff, 0x07ff, 0x07ff,
@@ -49,140 +48,265 @@ int stic_or[64] = {
     0x3fff, 0x3fff, 0x3fff, 0x3fff, 0x3fff, 0x3fff, 0x3fff, 0x3fff,
 };
 
-void writeMem(int adr, int val) // Write (should handle hooks/alias)
+// Memory map, one entry per 256-word page.  Plain ROM and RAM pages point
+// straight into Memory; pages with side effects (STIC, PSG, Intellivoice,
+// GRAM aliases, 8-bit RAM, ROM write protection) go through a handler.
+
+int readSTIC(intv_machine *m, int adr) // Page 0x00 and STIC aliases at 0x4000, 0x8000, 0xC000
 {
-    val &= 0xFFFF;
-    adr &= 0xFFFF;
-    
-    // Ignore writes to protected ROM spaces
-    // Note: B17 Bomber manages to write on EXEC ROM (it will crash if unprotected)
-    switch (adr >> 11) {
-        case 0x02:  /* Exec ROM */
-        case 0x03:
-        case 0x06:  /* GROM */
-        case 0x0a:  /* 5000-57FF */
-        case 0x0b:  /* 5800-5FFF */
-        case 0x0c:  /* 6000-67FF */
-        case 0x0d:  /* 6800-6FFF */
-        case 0x14:  /* A000-A7FF */
-        case 0x15:  /* A800-AFFF */
-        case 0x16:  /* B000-B7FF */
-        case 0x1a:  /* D000-D7FF */
-            if (d000_ram && adr <= 0xD3FF) {
-                Memory[adr] = val & 0xFF; /* RAM 8 */
-            }
-            return;
-        case 0x1b:  /* D800-DFFF */
-        case 0x1c:  /* E000-E7FF */
-        case 0x1d:  /* E800-EFFF */
-        case 0x1e:  /* F000-F7FF */
-            return; /* Ignore */
-        case 0x07:  /* GRAM 3800-3fff */
-        case 0x0f:  /* GRAM 7800-7fff */
-        case 0x17:  /* GRAM B800-BFFF */
-        case 0x1f:  /* GRAM F800-FFFF */
-            if (stic_gram != 0) {
-                // GRAM is 8-bit memory
-                // Note: Without the AND 0xff, Tower of Doom fails as it builds
-                // map from GRAM.
-                Memory[adr & 0x39FF] = val & 0xff;
-            }
-            return;
+    int val;
+
+    if (adr == 0x80 || adr == 0x81)
+    {
+        m->mem_events++; // Intellivoice status changes with time
+        SyncAudio(m);
+        return ivoice_rd(m, adr & 1);
     }
-    if (adr == 0x80 || adr == 0x81) {
-        ivoice_wr(adr & 1, val);
-        return;
+    // STIC access
+    if ((adr & 0x3fc0) == 0x0000) {
+        if (m->stic_reg != 0 && (adr & 0x3f) == 0x21)
+            m->STICMode = 1;   // Color Stack mode
+        if (adr >= 0x4000)
+            return 0xffff;
+        if (m->stic_reg == 0)  // Return trash
+            return adr & 0x0e;
+        adr &= 0x3f;
+        val = (m->Memory[adr] & stic_and[adr]) | stic_or[adr];
+        return val;
     }
-    if(adr>=0x100 && adr<=0x1FF)
-    {
-        val = val & 0xFF;
-        Memory[adr] = val;
-        //PSG Registers
-        if(adr>=0x01F0 && adr<=0x1FD)
-        {
-            PSGNotify(adr, val);
-        }
+    return m->Memory[adr];
+}
+
+int readRAM8(intv_machine *m, int adr) // Scratch RAM, PSG, controllers, $D000-$D3FF RAM 8
+{
+    return m->Memory[adr] & 0xFF;
+}
+
+void writeSTIC(intv_machine *m, int adr, int val)
+{
+    if (adr == 0x80 || adr == 0x81) {
+        SyncAudio(m);
+        ivoice_wr(m, adr & 1, val);
         return;
     }
-    
     // STIC access
     if ((adr & 0x3fc0) == 0x0000) {
-        if (stic_reg != 0) {
+        if (m->stic_reg != 0) {
             adr &= 0x3f;
             // STIC Display Enable
             if (adr == 0x20)
-                DisplayEnabled = 1;
+                m->DisplayEnabled = 1;
             // STIC Mode Select
             if (adr == 0x21)
-                STICMode = 0;   // Foreground/Background mode
-            Memory[adr] = (val & stic_and[adr]) | stic_or[adr];
+                m->STICMode = 0;   // Foreground/Background mode
+            m->Memory[adr] = (val & stic_and[adr]) | stic_or[adr];
+            MemoryMarkDirty(m, adr);
         }
         return;
     }
-    
-    Memory[adr] = val;
-    
+    m->Memory[adr] = val;
+    MemoryMarkDirty(m, adr);
+    CP1610Invalidate(m, adr);
 }
 
-int readMem(int adr) // Read (should handle hooks/alias)
+void writeScratch(intv_machine *m, int adr, int val) // 0x100-0x1FF
 {
-	// It's safe to map ROM over GRAM aliases
+    val = val & 0xFF;
+    MemoryMarkDirty(m, adr); // also covers PSGNotify masking the register
+    //PSG Registers
+    if(adr>=0x01F0 && adr<=0x1FD)
+    {
+        SyncAudio(m); // PSGTick reads the registers from Memory
+        m->Memory[adr] = val;
+        PSGNotify(m, adr, val);
+        return;
+    }
+    m->Memory[adr] = val;
+}
 
-    int val;
-    
-    adr &= 0xffff;
-    if (adr == 0x80 || adr == 0x81)
-        return ivoice_rd(adr & 1);
-    // STIC access
-    if ((adr & 0x3fc0) == 0x0000) {
-        if (stic_reg != 0 && (adr & 0x3f) == 0x21)
-            STICMode = 1;   // Color Stack mode
-        if (adr >= 0x4000)
-            return 0xffff;
-        if (stic_reg == 0)  // Return trash
-            return adr & 0x0e;
-        adr &= 0x3f;
-        val = (Memory[adr] & stic_and[adr]) | stic_or[adr];
-        return val;
-	}
-    val = Memory[adr];
+void writeRAM8(intv_machine *m, int adr, int val)
+{
+    m->Memory[adr] = val & 0xFF; /* RAM 8 */
+    MemoryMarkDirty(m, adr);
+    CP1610Invalidate(m, adr);
+}
 
-	if(adr>=0x100 && adr<=0x1FF)
-	{
-		val = val & 0xFF;
-	}
+void writeGRAM(intv_machine *m, int adr, int val) // GRAM 3800-3FFF and its aliases
+{
+    if (m->stic_gram != 0) {
+        // GRAM is 8-bit memory
+        // Note: Without the AND 0xff, Tower of Doom fails as it builds
+        // map from GRAM.
+        m->Memory[adr & 0x39FF] = val & 0xff;
+        MemoryMarkDirty(m, adr & 0x39FF);
+        CP1610Invalidate(m, adr & 0x39FF);
+    }
+}
+
+void writeROM(intv_machine *m, int adr, int val)
+{
+    // Ignore writes to protected ROM spaces
+    (void) m; (void) adr; (void) val;
+}
+
+void MemoryMapRAM8(intv_machine *m, int start, int stop) // map 8-bit RAM (e.g. USCF Chess $D000-$D3FF)
+{
+    int page;
+    for(page=start>>8; page<=(stop>>8); page++)
+    {
+        m->ReadPage[page] = NULL;
+        m->ReadHandler[page] = readRAM8;
+        m->WritePage[page] = NULL;
+        m->WriteHandler[page] = writeRAM8;
+    }
+}
+
+void MemoryMapReset(intv_machine *m)
+{
+    int page;
+    for(page=0; page<256; page++)
+    {
+        m->ReadPage[page] = &m->Memory[page<<8];
+        m->ReadHandler[page] = NULL;
+        m->WritePage[page] = &m->Memory[page<<8];
+        m->WriteHandler[page] = NULL;
+
+        switch (page >> 3) {
+            case 0x02:  /* Exec ROM */
+            case 0x03:
+            case 0x06:  /* GROM */
+            case 0x0a:  /* 5000-57FF */
+            case 0x0b:  /* 5800-5FFF */
+            case 0x0c:  /* 6000-67FF */
+            case 0x0d:  /* 6800-6FFF */
+            case 0x14:  /* A000-A7FF */
+            case 0x15:  /* A800-AFFF */
+            case 0x16:  /* B000-B7FF */
+            case 0x1a:  /* D000-D7FF */
+            case 0x1b:  /* D800-DFFF */
+            case 0x1c:  /* E000-E7FF */
+            case 0x1d:  /* E800-EFFF */
+            case 0x1e:  /* F000-F7FF */
+                // Note: B17 Bomber manages to write on EXEC ROM (it will crash if unprotected)
+                m->WritePage[page] = NULL;
+                m->WriteHandler[page] = writeROM;
+                break;
+            case 0x07:  /* GRAM 3800-3fff */
+            case 0x0f:  /* GRAM 7800-7fff */
+            case 0x17:  /* GRAM B800-BFFF */
+            case 0x1f:  /* GRAM F800-FFFF */
+                m->WritePage[page] = NULL;
+                m->WriteHandler[page] = writeGRAM;
+                break;
+        }
+    }
+    // STIC registers, Intellivoice and their aliases
+    for(page=0x00; page<=0xC0; page+=0x40)
+    {
+        m->ReadPage[page] = NULL;
+        m->ReadHandler[page] = readSTIC;
+        m->WritePage[page] = NULL;
+        m->WriteHandler[page] = writeSTIC;
+    }
+    // 8-bit scratch RAM, PSG, controllers
+    m->ReadPage[0x01] = NULL;
+    m->ReadHandler[0x01] = readRAM8;
+    m->WritePage[0x01] = NULL;
+    m->WriteHandler[0x01] = writeScratch;
+}
+
+// Savestates skip the other pages, their contents come from loading the game.
+// GRAM aliases store into $3800-$39FF, which is writable itself.
+int MemoryPageWritable(intv_machine *m, int page)
+{
+    return m->WritePage[page] != NULL ||
+           (m->WriteHandler[page] != writeROM && m->WriteHandler[page] != writeGRAM) ||
+           page == 0x38 || page == 0x39;
+}
 
-	if(d000_ram && adr>=0xD000 && adr<=0xD3FF)
-	{
-		val = val & 0xFF; /* RAM 8 */
-	}
+void MemoryMarkAllDirty(intv_machine *m)
+{
+    memset(m->DirtyPages, 0xFF, sizeof(m->DirtyPages));
+}
 
-	return val;
+// Fills pages[] (room for 256) with the pages of Memory written since the
+// previous call and starts a new checkpoint.  Savestate, rewind or RAM
+// watch code can copy just these pages instead of all of Memory.
+int MemoryDirtyPages(intv_machine *m, unsigned char *pages)
+{
+    int i, bit, count = 0;
+    uint32_t bits;
+
+    for(i=0; i<8; i++)
+    {
+        bits = m->DirtyPages[i];
+        m->DirtyPages[i] = 0;
+        for(bit=0; bits != 0; bit++, bits >>= 1)
+        {
+            if(bits & 1) { pages[count++] = (i<<5) | bit; }
+        }
+    }
+    return count;
+}
+
+void writeMem(intv_machine *m, int adr, int val) // Write (should handle hooks/alias)
+{
+    unsigned int *page;
+
+    val &= 0xFFFF;
+    adr &= 0xFFFF;
+    m->mem_events++;
+
+    page = m->WritePage[adr >> 8];
+    if (page != NULL) {
+        page[adr & 0xFF] = val;
+        MemoryMarkDirty(m, adr);
+        CP1610Invalidate(m, adr);
+        return;
+    }
+    m->WriteHandler[adr >> 8](m, adr, val);
+}
+
+int readMem(intv_machine *m, int adr) // Read (should handle hooks/alias)
+{
+	// It's safe to map ROM over GRAM aliases
+
+    unsigned int *page;
+
+    adr &= 0xffff;
+    page = m->ReadPage[adr >> 8];
+    if (page != NULL) {
+        return page[adr & 0xFF];
+    }
+    return m->ReadHandler[adr >> 8](m, adr);
 }
 
-void MemoryInit()
+void MemoryInit(intv_machine *m)
 {
 	int i;
-	d000_ram = 0; /* reset per-cart flags before loading new cart */
-	for(i=0x0000; i<=0x0007; i++) { Memory[i] = 0x3800; } /* STIC Registers */
-	for(i=0x0008; i<=0x000F; i++) { Memory[i] = 0x3000; }
-	for(i=0x0010; i<=0x0017; i++) { Memory[i] = 0x0000; }
-	for(i=0x0018; i<=0x001F; i++) { Memory[i] = 0x3C00; }
-	for(i=0x0020; i<=0x003F; i++) { Memory[i] = 0x3FFF; }
-	for(i=0x0028; i<=0x002C; i++) { Memory[i] = 0x3FF0; }
-	Memory[0x30] = 0x3FF8;
-	Memory[0x31] = 0x3FF8;
-	Memory[0x32] = 0x3FFC;
-	for(i=0x0040; i<=0x007F; i++) { Memory[i] = 0x0000; }
-	for(i=0x0080; i<=0x00FF; i++) { Memory[i] = 0xFFFF; }
-	for(i=0x0100; i<=0x035F; i++) { Memory[i] = 0x0000; } // Scratch, PSG (1F0-1FF), System Ram
-	for(i=0x0360; i<=0x0FFF; i++) { Memory[i] = 0xFFFF; }
-	for(i=0x1000; i<=0x1FFF; i++) { Memory[i] = 0x0000; } // EXEC ROM
-	for(i=0x2000; i<=0x2FFF; i++) { Memory[i] = 0xFFFF; }
-	for(i=0x3000; i<=0x3FFF; i++) { Memory[i] = 0x0000; } // GROM, GRAM
-	for(i=0x4000; i<=0x4FFF; i++) { Memory[i] = 0xFFFF; }
-	for(i=0x5000; i<=0x5FFF; i++) { Memory[i] = 0x0000; }
-	for(i=0x6000; i<=0xFFFF; i++) { Memory[i] = 0xFFFF; }
-	Memory[0x1FE] = 0xFF; /* Controller R */
-	Memory[0x1FF] = 0xFF; /* Controller L */
+	m->d000_ram = 0; /* reset per-cart flags before loading new cart */
+	MemoryMapReset(m);
+	for(i=0x0000; i<=0x0007; i++) { m->Memory[i] = 0x3800; } /* STIC Registers */
+	for(i=0x0008; i<=0x000F; i++) { m->Memory[i] = 0x3000; }
+	for(i=0x0010; i<=0x0017; i++) { m->Memory[i] = 0x0000; }
+	for(i=0x0018; i<=0x001F; i++) { m->Memory[i] = 0x3C00; }
+	for(i=0x0020; i<=0x003F; i++) { m->Memory[i] = 0x3FFF; }
+	for(i=0x0028; i<=0x002C; i++) { m->Memory[i] = 0x3FF0; }
+	m->Memory[0x30] = 0x3FF8;
+	m->Memory[0x31] = 0x3FF8;
+	m->Memory[0x32] = 0x3FFC;
+	for(i=0x0040; i<=0x007F; i++) { m->Memory[i] = 0x0000; }
+	for(i=0x0080; i<=0x00FF; i++) { m->Memory[i] = 0xFFFF; }
+	for(i=0x0100; i<=0x035F; i++) { m->Memory[i] = 0x0000; } // Scratch, PSG (1F0-1FF), System Ram
+	for(i=0x0360; i<=0x0FFF; i++) { m->Memory[i] = 0xFFFF; }
+	for(i=0x1000; i<=0x1FFF; i++) { m->Memory[i] = 0x0000; } // EXEC ROM
+	for(i=0x2000; i<=0x2FFF; i++) { m->Memory[i] = 0xFFFF; }
+	for(i=0x3000; i<=0x3FFF; i++) { m->Memory[i] = 0x0000; } // GROM, GRAM
+	for(i=0x4000; i<=0x4FFF; i++) { m->Memory[i] = 0xFFFF; }
+	for(i=0x5000; i<=0x5FFF; i++) { m->Memory[i] = 0x0000; }
+	for(i=0x6000; i<=0xFFFF; i++) { m->Memory[i] = 0xFFFF; }
+	m->Memory[0x1FE] = 0xFF; /* Controller R */
+	m->Memory[0x1FF] = 0xFF; /* Controller L */
+	MemoryMarkAllDirty(m);
+	CP1610FlushCache(m);
 }
@@ -18,14 +18,25 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
-extern unsigned int Memory[0x10000];
+#include "intv.h"
 
-extern int d000_ram; /* 1 = $D000-$D3FF is 8-bit RAM (e.g. USCF Chess) */
+void MemoryInit(intv_machine *m);
 
-void MemoryInit(void);
+void MemoryMapReset(intv_machine *m);
 
-int readMem(int adr);
+void MemoryMapRAM8(intv_machine *m, int start, int stop);
 
-void writeMem(int adr, int val);
+int MemoryPageWritable(intv_machine *m, int page); // can the CPU change this 256-word page of Memory
+
+// Dirty page tracking: every store into Memory marks its 256-word page.
+#define MemoryMarkDirty(m, adr) ((m)->DirtyPages[((adr) >> 13) & 7] |= 1u << (((adr) >> 8) & 31))
+
+void MemoryMarkAllDirty(intv_machine *m); // Memory was replaced wholesale (init, rom loads, states)
+
+int MemoryDirtyPages(intv_machine *m, unsigned char *pages); // list pages written since the last call, returns the count
+
+int readMem(intv_machine *m, int adr);
+
+void writeMem(intv_machine *m, int adr, int val);
 
 #endif
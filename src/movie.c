@@ -0,0 +1,358 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intv.h"
+#include "machine.h"
+#include "memory.h"
+#include "cp1610.h"
+#include "stic.h"
+#include "movie.h"
+
+#ifdef __LIBRETRO__
+#include <streams/file_stream.h>
+#define mfopen(path, mode) filestream_open(path, mode[0] == 'w' ? RETRO_VFS_FILE_ACCESS_WRITE : RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE)
+#define mfread(fp, data, size) (filestream_read(fp, data, size) == (int64_t)(size))
+#define mfwrite(fp, data, size) (filestream_write(fp, data, size) == (int64_t)(size))
+#define mfclose filestream_close
+typedef RFILE MFILE;
+#else
+#define mfopen fopen
+#define mfread(fp, data, size) (fread(data, 1, size, fp) == (size_t)(size))
+#define mfwrite(fp, data, size) (fwrite(data, 1, size, fp) == (size_t)(size))
+#define mfclose fclose
+typedef FILE MFILE;
+#endif
+
+#define HASH_START 0xCBF29CE484222325ULL
+
+// File layout, all little-endian:
+//   header  magic[8], interval, frames, runs, hashes (32 bits), cart hash (64 bits)
+//   runs    count (16 bits), input0, input1, flags -- frames with the same input
+//   hashes  64 bits each, after frames interval-1, 2*interval-1, ...
+#define HEADER_SIZE 32
+#define RUN_SIZE 5
+#define RUN_RESET 0x01 // the console was reset before the first frame of the run
+
+struct movie_frame
+{
+	unsigned char input[2]; // Memory $1FE and $1FF
+	unsigned char reset;
+};
+
+struct intv_movie
+{
+	int playing;   // 0 recording, 1 playing back
+	int interval;  // frames per hash
+	int frames;    // frames recorded, or frames in the movie
+	int capacity;
+	int pos;       // current frame
+	int resetPending;
+	uint64_t cart; // hash of the cart image
+	struct movie_frame *frame;
+	uint64_t *hash;
+};
+
+static uint64_t hashWord(uint64_t h, unsigned int v)
+{
+	return (h ^ v) * 0x100000001B3ULL;
+}
+
+static uint64_t cartHash(intv_machine *m)
+{
+	uint64_t h = HASH_START;
+	int i;
+
+	for(i=0; i<m->cart_size; i++)
+	{
+		h = hashWord(h, m->cart_data[i]);
+	}
+	return h;
+}
+
+// Architectural state only: the flags are extracted, so a different way of
+// keeping them inside the core hashes the same.
+uint64_t MovieHash(intv_machine *m)
+{
+	uint64_t h = HASH_START;
+	uint8_t presented[352*224];
+	int i;
+
+	STICFinishFrame(m); // the frame of this step, not the one shown
+	for(i=0; i<0x10000; i++)
+	{
+		h = hashWord(h, m->Memory[i] & 0xFFFF);
+	}
+	for(i=0; i<8; i++)
+	{
+		h = hashWord(h, m->R[i] & 0xFFFF);
+	}
+	h = hashWord(h, (FlagSign(m) << 5) | (FlagZero(m) << 4) | (FlagCarry(m) << 3) | (FlagOverflow(m) << 2) |
+		((m->Flag_InteruptEnable != 0) << 1) | (m->Flag_DoubleByteData != 0));
+	STICFrameToIndex(m, presented);
+	for(i=0; i<352*224; i++)
+	{
+		h = hashWord(h, presented[i]);
+	}
+	return h;
+}
+
+static intv_movie *movieAlloc(int frames)
+{
+	intv_movie *mv = (intv_movie *) calloc(1, sizeof(intv_movie));
+
+	if(mv == NULL) { return NULL; }
+	mv->capacity = frames > 3600 ? frames : 3600;
+	mv->frame = (struct movie_frame *) malloc(mv->capacity * sizeof(struct movie_frame));
+	mv->hash = (uint64_t *) malloc((mv->capacity + 1) * sizeof(uint64_t));
+	if(mv->frame == NULL || mv->hash == NULL)
+	{
+		MovieDestroy(mv);
+		return NULL;
+	}
+	return mv;
+}
+
+// the hash array keeps room for one per frame, so it grows along
+static int movieGrow(intv_movie *mv)
+{
+	int capacity = mv->capacity * 2;
+	struct movie_frame *frame;
+	uint64_t *hash;
+
+	frame = (struct movie_frame *) realloc(mv->frame, capacity * sizeof(struct movie_frame));
+	if(frame == NULL) { return 0; }
+	mv->frame = frame;
+	hash = (uint64_t *) realloc(mv->hash, (capacity + 1) * sizeof(uint64_t));
+	if(hash == NULL) { return 0; }
+	mv->hash = hash;
+	mv->capacity = capacity;
+	return 1;
+}
+
+intv_movie *MovieCreate(intv_machine *m, int interval)
+{
+	intv_movie *mv = movieAlloc(0);
+
+	if(mv == NULL) { return NULL; }
+	mv->interval = interval > 0 ? interval : MOVIE_HASH_INTERVAL;
+	mv->cart = cartHash(m);
+	return mv;
+}
+
+void MovieDestroy(intv_movie *mv)
+{
+	if(mv == NULL) { return; }
+	free(mv->frame);
+	free(mv->hash);
+	free(mv);
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int MovieSave(intv_movie *mv, const char *path)
+{
+	unsigned char *data, *p;
+	int hashes = mv->frames / mv->interval;
+	int runs = 0, f, i, ok;
+	MFILE *fp;
+
+	// worst case is one run per frame
+	data = (unsigned char *) malloc(HEADER_SIZE + mv->frames * RUN_SIZE + hashes * 8);
+	if(data == NULL) { return 0; }
+	p = data + HEADER_SIZE;
+	for(f=0; f<mv->frames; f=i)
+	{
+		for(i=f+1; i<mv->frames && i-f < 0xFFFF && !mv->frame[i].reset &&
+			memcmp(mv->frame[i].input, mv->frame[f].input, 2) == 0; i++) { }
+		p[0] = (i-f);
+		p[1] = (i-f) >> 8;
+		p[2] = mv->frame[f].input[0];
+		p[3] = mv->frame[f].input[1];
+		p[4] = mv->frame[f].reset ? RUN_RESET : 0;
+		p += RUN_SIZE;
+		runs++;
+	}
+	for(i=0; i<hashes; i++)
+	{
+		put32(p, (uint32_t) mv->hash[i]);
+		put32(p + 4, (uint32_t) (mv->hash[i] >> 32));
+		p += 8;
+	}
+	memcpy(data, MOVIE_MAGIC, 8);
+	put32(data + 8, mv->interval);
+	put32(data + 12, mv->frames);
+	put32(data + 16, runs);
+	put32(data + 20, hashes);
+	put32(data + 24, (uint32_t) mv->cart);
+	put32(data + 28, (uint32_t) (mv->cart >> 32));
+
+	fp = mfopen(path, "wb");
+	if(fp == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Failed writing movie to: %s\n", path);
+		free(data);
+		return 0;
+	}
+	ok = mfwrite(fp, data, p - data);
+	mfclose(fp);
+	free(data);
+	return ok;
+}
+
+intv_movie *MovieLoad(const char *path)
+{
+	unsigned char head[HEADER_SIZE];
+	unsigned char *data = NULL, *p;
+	intv_movie *mv = NULL;
+	uint32_t frames, runs, hashes, count, i;
+	int f = 0;
+	MFILE *fp = mfopen(path, "rb");
+
+	if(fp == NULL) { return NULL; }
+	if(!mfread(fp, head, HEADER_SIZE) || memcmp(head, MOVIE_MAGIC, 8) != 0 || get32(head + 8) == 0)
+	{
+		goto fail;
+	}
+	frames = get32(head + 12);
+	runs = get32(head + 16);
+	hashes = get32(head + 20);
+	if(frames > 0x7FFFFFF || runs > frames || hashes != frames / get32(head + 8))
+	{
+		goto fail;
+	}
+	data = (unsigned char *) malloc(runs * RUN_SIZE + hashes * 8 + 1);
+	mv = movieAlloc(frames);
+	if(data == NULL || mv == NULL || !mfread(fp, data, runs * RUN_SIZE + hashes * 8))
+	{
+		goto fail;
+	}
+	mv->playing = 1;
+	mv->interval = get32(head + 8);
+	mv->cart = get32(head + 24) | ((uint64_t) get32(head + 28) << 32);
+	for(p=data; p<data + runs * RUN_SIZE; p+=RUN_SIZE)
+	{
+		count = p[0] | (p[1] << 8);
+		if(count == 0 || f + count > frames) { goto fail; }
+		for(i=0; i<count; i++, f++)
+		{
+			mv->frame[f].input[0] = p[2];
+			mv->frame[f].input[1] = p[3];
+			mv->frame[f].reset = i == 0 && (p[4] & RUN_RESET);
+		}
+	}
+	if((uint32_t) f != frames) { goto fail; }
+	for(i=0; i<hashes; i++, p+=8)
+	{
+		mv->hash[i] = get32(p) | ((uint64_t) get32(p + 4) << 32);
+	}
+	mv->frames = frames;
+	mfclose(fp);
+	free(data);
+	return mv;
+
+fail:
+	mfclose(fp);
+	free(data);
+	MovieDestroy(mv);
+	return NULL;
+}
+
+int MovieMatchesCart(intv_movie *mv, intv_machine *m)
+{
+	return mv->cart == cartHash(m);
+}
+
+void MovieReset(intv_movie *mv)
+{
+	mv->resetPending = 1;
+}
+
+int MovieInput(intv_movie *mv, intv_machine *m)
+{
+	struct movie_frame *frame;
+
+	if(mv->playing)
+	{
+		if(mv->pos >= mv->frames) { return 0; }
+		frame = &mv->frame[mv->pos];
+		if(frame->reset)
+		{
+			Reset(m);
+		}
+		m->Memory[0x1FE] = frame->input[0];
+		m->Memory[0x1FF] = frame->input[1];
+		MemoryMarkDirty(m, 0x1FE);
+		return 1;
+	}
+	if(mv->pos >= mv->capacity && !movieGrow(mv))
+	{
+		return 0;
+	}
+	frame = &mv->frame[mv->pos];
+	frame->input[0] = m->Memory[0x1FE] & 0xFF;
+	frame->input[1] = m->Memory[0x1FF] & 0xFF;
+	frame->reset = mv->resetPending;
+	mv->resetPending = 0;
+	mv->frames = mv->pos + 1;
+
+	// a frame that gets hashed must be drawn, even when the frontend skips it
+	if(mv->frames % mv->interval == 0)
+	{
+		m->SkipVideo = 0;
+	}
+	return 1;
+}
+
+int MovieCheck(intv_movie *mv, intv_machine *m)
+{
+	int due = (mv->pos + 1) % mv->interval == 0;
+	int n = (mv->pos + 1) / mv->interval - 1;
+
+	if(mv->pos >= mv->frames) { return 1; } // MovieInput ran out
+	mv->pos++;
+	if(!due) { return 1; }
+	if(mv->playing)
+	{
+		return mv->hash[n] == MovieHash(m) ? 2 : 0;
+	}
+	mv->hash[n] = MovieHash(m);
+	return 1;
+}
+
+void MovieStepBack(intv_movie *mv)
+{
+	if(mv->playing || mv->pos == 0) { return; }
+	mv->pos--;
+	mv->frames = mv->pos;
+	mv->resetPending = 0;
+}
+
+int MovieFrames(intv_movie *mv)
+{
+	return mv->frames;
+}
@@ -0,0 +1,60 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdint.h>
+#include "intv.h"
+
+#define MOVIE_MAGIC "FIMOVIE2"
+
+#define MOVIE_HASH_INTERVAL 60 // frames between machine hashes when recording
+
+// Input movies.  A movie holds the controller bytes the game saw on every
+// frame since the cart was loaded, console resets, and a hash of Memory,
+// the CPU registers and the frame after every MOVIE_HASH_INTERVAL frames.
+// Playing one back headless shows whether a change to the core still
+// emulates the recorded session exactly, and where it first differs.
+//
+// Per frame, call MovieInput after the frontend set the controllers and
+// right before Run, then MovieCheck right after Run.
+typedef struct intv_movie intv_movie;
+
+intv_movie *MovieCreate(intv_machine *m, int interval); // start recording right after LoadGame, hashing every interval frames; NULL if out of memory
+
+intv_movie *MovieLoad(const char *path); // for playback, NULL if missing or damaged
+
+int MovieSave(intv_movie *mv, const char *path);
+
+void MovieDestroy(intv_movie *mv);
+
+int MovieMatchesCart(intv_movie *mv, intv_machine *m); // was the movie recorded with the loaded cart
+
+void MovieReset(intv_movie *mv); // recording: the console was reset before the next frame
+
+int MovieInput(intv_movie *mv, intv_machine *m); // record or play back one frame of input, returns 0 at the end of the movie
+
+int MovieCheck(intv_movie *mv, intv_machine *m); // record or compare the hash after the frame, returns 0 if the machine diverged, 2 if a hash matched
+
+void MovieStepBack(intv_movie *mv); // recording: rewind restored the machine one frame back
+
+int MovieFrames(intv_movie *mv);
+
+uint64_t MovieHash(intv_machine *m); // hash of Memory, CPU registers and frame
+
+#endif
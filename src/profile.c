@@ -0,0 +1,215 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "profile.h"
+
+#ifdef __LIBRETRO__
+#include <streams/file_stream.h>
+#define PFILE RFILE
+#define pfopen(path) filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE, RETRO_VFS_FILE_ACCESS_HINT_NONE)
+#define pfprintf filestream_printf
+#define pfclose filestream_close
+#else
+#define PFILE FILE
+#define pfopen(path) fopen(path, "w")
+#define pfprintf fprintf
+#define pfclose fclose
+#endif
+
+#define REPORT_LINES 100 // addresses listed in the sorted report
+
+extern const char *Nmemonic[0x400];
+
+int ProfileEnabled = 0;
+
+uint64_t ProfileCount[0x10000];  // instructions executed at each address
+uint64_t ProfileCycles[0x10000]; // cycles used by them
+int ProfileOpcode[0x10000];      // last opcode seen at each address
+
+uint64_t ProfileOpCount[0x400];
+uint64_t ProfileOpCycles[0x400];
+
+uint64_t MnemonicCount[0x400];  // ProfileOp* summed per mnemonic (ProfileDump)
+uint64_t MnemonicCycles[0x400];
+
+int order[0x10000]; // addresses or mnemonics sorted by cycles
+
+void ProfileReset(void)
+{
+	int i;
+	for(i=0; i<0x10000; i++)
+	{
+		ProfileCount[i] = 0;
+		ProfileCycles[i] = 0;
+		ProfileOpcode[i] = 0;
+	}
+	for(i=0; i<0x400; i++)
+	{
+		ProfileOpCount[i] = 0;
+		ProfileOpCycles[i] = 0;
+	}
+}
+
+void ProfileSetEnabled(int enabled)
+{
+	if(enabled && !ProfileEnabled)
+	{
+		ProfileReset();
+	}
+	ProfileEnabled = enabled;
+}
+
+void ProfileHit(int pc, int instruction, int ticks)
+{
+	pc &= 0xFFFF;
+	ProfileCount[pc]++;
+	ProfileCycles[pc] += ticks;
+	ProfileOpcode[pc] = instruction;
+	ProfileOpCount[instruction]++;
+	ProfileOpCycles[instruction] += ticks;
+}
+
+uint64_t ProfileInstructions(void)
+{
+	uint64_t count = 0;
+	int i;
+	for(i=0; i<0x400; i++)
+	{
+		count += ProfileOpCount[i];
+	}
+	return count;
+}
+
+const char *mnemonic(int op) // Nmemonic without the padding
+{
+	static char name[16];
+	int i;
+	snprintf(name, sizeof(name), "%s", Nmemonic[op] ? Nmemonic[op] : "???");
+	for(i=(int)strlen(name); i>0 && name[i-1]==' '; i--) { name[i-1] = 0; }
+	return name;
+}
+
+int compareAddress(const void *a, const void *b)
+{
+	uint64_t x = ProfileCycles[*(const int *)a];
+	uint64_t y = ProfileCycles[*(const int *)b];
+	return (x < y) - (x > y);
+}
+
+int compareMnemonic(const void *a, const void *b)
+{
+	uint64_t x = MnemonicCycles[*(const int *)a];
+	uint64_t y = MnemonicCycles[*(const int *)b];
+	return (x < y) - (x > y);
+}
+
+int ProfileDump(const char *path)
+{
+	char name[1024];
+	PFILE *fp;
+	uint64_t count = 0;
+	uint64_t cycles = 0;
+	int i, j, k, used;
+
+	for(i=0; i<0x10000; i++)
+	{
+		count += ProfileCount[i];
+		cycles += ProfileCycles[i];
+	}
+	if(cycles == 0) { cycles = 1; }
+
+	// Flat per-address table //
+	snprintf(name, sizeof(name), "%s.csv", path);
+	if((fp = pfopen(name)) == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Failed writing profile to: %s\n", name);
+		return 0;
+	}
+	pfprintf(fp, "address,opcode,mnemonic,count,cycles\n");
+	for(i=0; i<0x10000; i++)
+	{
+		if(ProfileCount[i] != 0)
+		{
+			pfprintf(fp, "%04X,%03X,%s,%llu,%llu\n", i, ProfileOpcode[i], mnemonic(ProfileOpcode[i]),
+				(unsigned long long)ProfileCount[i], (unsigned long long)ProfileCycles[i]);
+		}
+	}
+	pfclose(fp);
+
+	// Sorted report //
+	snprintf(name, sizeof(name), "%s.txt", path);
+	if((fp = pfopen(name)) == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Failed writing profile to: %s\n", name);
+		return 0;
+	}
+	pfprintf(fp, "FreeIntv CP-1610 profile: %llu instructions, %llu cycles\n\n",
+		(unsigned long long)count, (unsigned long long)cycles);
+
+	used = 0;
+	for(i=0; i<0x10000; i++)
+	{
+		if(ProfileCount[i] != 0) { order[used++] = i; }
+	}
+	qsort(order, used, sizeof(order[0]), compareAddress);
+	pfprintf(fp, "Top addresses by cycles\n");
+	pfprintf(fp, "ADDR  OP   MNEMONIC      COUNT       CYCLES      %%\n");
+	for(i=0; i<used && i<REPORT_LINES; i++)
+	{
+		k = order[i];
+		pfprintf(fp, "%04X  %03X  %s  %12llu %12llu %6.2f\n", k, ProfileOpcode[k], Nmemonic[ProfileOpcode[k]],
+			(unsigned long long)ProfileCount[k], (unsigned long long)ProfileCycles[k],
+			100.0 * ProfileCycles[k] / cycles);
+	}
+
+	// Opcodes sharing a mnemonic are summed into the first of them //
+	for(i=0; i<0x400; i++)
+	{
+		MnemonicCount[i] = 0;
+		MnemonicCycles[i] = 0;
+	}
+	for(i=0; i<0x400; i++)
+	{
+		if(Nmemonic[i] == NULL) { continue; }
+		for(j=0; Nmemonic[j] != Nmemonic[i]; j++) { }
+		MnemonicCount[j] += ProfileOpCount[i];
+		MnemonicCycles[j] += ProfileOpCycles[i];
+	}
+	used = 0;
+	for(i=0; i<0x400; i++)
+	{
+		if(MnemonicCount[i] != 0) { order[used++] = i; }
+	}
+	qsort(order, used, sizeof(order[0]), compareMnemonic);
+	pfprintf(fp, "\nMnemonics by cycles\n");
+	pfprintf(fp, "MNEMONIC      COUNT       CYCLES      %%\n");
+	for(i=0; i<used; i++)
+	{
+		k = order[i];
+		pfprintf(fp, "%s  %12llu %12llu %6.2f\n", Nmemonic[k],
+			(unsigned long long)MnemonicCount[k], (unsigned long long)MnemonicCycles[k],
+			100.0 * MnemonicCycles[k] / cycles);
+	}
+	pfclose(fp);
+
+	printf("[INFO] [FREEINTV] Profile written to: %s.txt and %s.csv\n", path, path);
+	return 1;
+}
@@ -0,0 +1,35 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdint.h>
+
+extern int ProfileEnabled; // 1 = exec() counts every instruction
+
+void ProfileSetEnabled(int enabled); // counters are cleared when profiling starts
+
+void ProfileReset(void);
+
+void ProfileHit(int pc, int instruction, int ticks); // called by CP1610TickProfile
+
+uint64_t ProfileInstructions(void); // instructions counted since profiling started
+
+int ProfileDump(const char *path); // writes path.txt (sorted report) and path.csv (per address)
+
+#endif
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include "machine.h"
 #include "psg.h"
 #include "memory.h"
 
@@ -27,166 +28,154 @@ int Volume[16] = { 0, 92, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072,
 int Envelope_Shift[4] = {8, 2, 1, 0};
 
 // Volume levels assigned to each channel from PSG registers
-#define VolA    (Memory[0x01FB] & 0x0F)
-#define VolB    (Memory[0x01FC] & 0x0F)
-#define VolC    (Memory[0x01FD] & 0x0F)
+#define VolA    (m->Memory[0x01FB] & 0x0F)
+#define VolB    (m->Memory[0x01FC] & 0x0F)
+#define VolC    (m->Memory[0x01FD] & 0x0F)
 
 // Envelope shifts for channels (6-bit variations only)
-#define EnvA    ((Memory[0x01FB] >> 4) & 0x03)
-#define EnvB    ((Memory[0x01FC] >> 4) & 0x03)
-#define EnvC    ((Memory[0x01FD] >> 4) & 0x03)
-
-int NoiseP; // Noise Period
+#define EnvA    ((m->Memory[0x01FB] >> 4) & 0x03)
+#define EnvB    ((m->Memory[0x01FC] >> 4) & 0x03)
+#define EnvC    ((m->Memory[0x01FD] >> 4) & 0x03)
 
 // Detect Tone enabled for this channel (0- enabled, 1- disabled)
-#define ToneA   ((Memory[0x01F8] & 0x01) != 0)
-#define ToneB   ((Memory[0x01F8] & 0x02) != 0)
-#define ToneC   ((Memory[0x01F8] & 0x04) != 0)
+#define ToneA   ((m->Memory[0x01F8] & 0x01) != 0)
+#define ToneB   ((m->Memory[0x01F8] & 0x02) != 0)
+#define ToneC   ((m->Memory[0x01F8] & 0x04) != 0)
            
 // Detect Noise enabled for this channel (0- enabled, 1- disabled)
-#define NoiseA  ((Memory[0x01F8] & 0x08) != 0)
-#define NoiseB  ((Memory[0x01F8] & 0x10) != 0)
-#define NoiseC  ((Memory[0x01F8] & 0x20) != 0)
+#define NoiseA  ((m->Memory[0x01F8] & 0x08) != 0)
+#define NoiseB  ((m->Memory[0x01F8] & 0x10) != 0)
+#define NoiseC  ((m->Memory[0x01F8] & 0x20) != 0)
 
 // Envelope type
-#define EnvFlags    (Memory[0x01FA] & 0x0F)
-
-int PSGBufferSize;
-int16_t PSGBuffer[7467];
-int PSGBufferPos;
-
-int Ticks; // CPU cycles not yet processed
-
-int CountA; // countdowns for tone generators
-int CountB; // used to modulate square-wave
-int CountC; // according to Channel Period
-int CountN; // countdown for noise generator
-int CountE; // countdown for envelope generator
+#define EnvFlags    (m->Memory[0x01FA] & 0x0F)
 
-int OutA; // outputs for each tone generator
-int OutB;
-int OutC;
-int OutN;  // Noise generator output
-int OutE;  // Envelope generator output
-
-int ChA; // Channel Period from PSG Registers
-int ChB;
-int ChC;
+void PSGSerialize(intv_machine *m, struct PSGserialized *all)
+{
+    all->PSGBufferSize = m->PSGBufferSize;
+    all->PSGBufferPos = m->PSGBufferPos;
+    all->Ticks = m->Ticks;
+    all->CountA = m->CountA;
+    all->CountB = m->CountB;
+    all->CountC = m->CountC;
+    all->CountN = m->CountN;
+    all->CountE = m->CountE;
+    all->OutA = m->OutA;
+    all->OutB = m->OutB;
+    all->OutC = m->OutC;
+    all->OutN = m->OutN;
+    all->OutE = m->OutE;
+    all->ChA = m->ChA;
+    all->ChB = m->ChB;
+    all->ChC = m->ChC;
+    all->NoiseP = m->NoiseP;
+    all->EnvP = m->EnvP;
+    all->StepE = m->StepE;
+    all->EnvContinue = m->EnvContinue;
+    all->EnvAttack = m->EnvAttack;
+    all->EnvAlternate = m->EnvAlternate;
+    all->EnvHold = m->EnvHold;
+}
 
-int EnvP;    // Envelope Period
-int StepE; // 1, 0, -1 -- Direction to Step Envelope at end of countdown
+void PSGUnserialize(intv_machine *m, const struct PSGserialized *all)
+{
+    m->PSGBufferSize = all->PSGBufferSize;
+    m->PSGBufferPos = all->PSGBufferPos;
+    m->Ticks = all->Ticks;
+    m->CountA = all->CountA;
+    m->CountB = all->CountB;
+    m->CountC = all->CountC;
+    m->CountN = all->CountN;
+    m->CountE = all->CountE;
+    m->OutA = all->OutA;
+    m->OutB = all->OutB;
+    m->OutC = all->OutC;
+    m->OutN = all->OutN;
+    m->OutE = all->OutE;
+    m->ChA = all->ChA;
+    m->ChB = all->ChB;
+    m->ChC = all->ChC;
+    m->NoiseP = all->NoiseP;
+    m->EnvP = all->EnvP;
+    m->StepE = all->StepE;
+    m->EnvContinue = all->EnvContinue;
+    m->EnvAttack = all->EnvAttack;
+    m->EnvAlternate = all->EnvAlternate;
+    m->EnvHold = all->EnvHold;
+}
 
-int EnvContinue; // Flags from Envelope Type
-int EnvAttack;
-int EnvAlternate;
-int EnvHold;
+// Only the samples not yet played are kept, PSGFrame rewinds the buffer
+int PSGSerializeBuffer(intv_machine *m, int16_t *data)
+{
+    memcpy(data, m->PSGBuffer, m->PSGBufferPos * sizeof(int16_t));
+    return m->PSGBufferPos;
+}
 
-void PSGSerialize(struct PSGserialized *all)
+int PSGCheckBuffer(const struct PSGserialized *all, int size)
 {
-    all->PSGBufferSize = PSGBufferSize;
-    memcpy(all->PSGBuffer, PSGBuffer, sizeof(PSGBuffer));
-    all->PSGBufferPos = PSGBufferPos;
-    all->Ticks = Ticks;
-    all->CountA = CountA;
-    all->CountB = CountB;
-    all->CountC = CountC;
-    all->CountN = CountN;
-    all->CountE = CountE;
-    all->OutA = OutA;
-    all->OutB = OutB;
-    all->OutC = OutC;
-    all->OutN = OutN;
-    all->OutE = OutE;
-    all->ChA = ChA;
-    all->ChB = ChB;
-    all->ChC = ChC;
-    all->NoiseP = NoiseP;
-    all->EnvP = EnvP;
-    all->StepE = StepE;
-    all->EnvContinue = EnvContinue;
-    all->EnvAttack = EnvAttack;
-    all->EnvAlternate = EnvAlternate;
-    all->EnvHold = EnvHold;
+    if (all->PSGBufferSize != 7467 || all->PSGBufferPos < 0 || all->PSGBufferPos >= 7467 || all->PSGBufferPos > size)
+    {
+        return -1;
+    }
+    return all->PSGBufferPos;
 }
 
-void PSGUnserialize(const struct PSGserialized *all)
+int PSGUnserializeBuffer(intv_machine *m, const int16_t *data)
 {
-    PSGBufferSize = all->PSGBufferSize;
-    memcpy(PSGBuffer, all->PSGBuffer, sizeof(PSGBuffer));
-    PSGBufferPos = all->PSGBufferPos;
-    Ticks = all->Ticks;
-    CountA = all->CountA;
-    CountB = all->CountB;
-    CountC = all->CountC;
-    CountN = all->CountN;
-    CountE = all->CountE;
-    OutA = all->OutA;
-    OutB = all->OutB;
-    OutC = all->OutC;
-    OutN = all->OutN;
-    OutE = all->OutE;
-    ChA = all->ChA;
-    ChB = all->ChB;
-    ChC = all->ChC;
-    NoiseP = all->NoiseP;
-    EnvP = all->EnvP;
-    StepE = all->StepE;
-    EnvContinue = all->EnvContinue;
-    EnvAttack = all->EnvAttack;
-    EnvAlternate = all->EnvAlternate;
-    EnvHold = all->EnvHold;
+    memcpy(m->PSGBuffer, data, m->PSGBufferPos * sizeof(int16_t));
+    return m->PSGBufferPos;
 }
 
-void readRegisters(void)
+void readRegisters(intv_machine *m)
 {
-	ChA = (Memory[0x01F0] & 0xFF) | ((Memory[0x1F4] & 0x0F)<<8);
-	ChB = (Memory[0x01F1] & 0xFF) | ((Memory[0x1F5] & 0x0F)<<8);
-	ChC = (Memory[0x01F2] & 0xFF) | ((Memory[0x1F6] & 0x0F)<<8);
+	m->ChA = (m->Memory[0x01F0] & 0xFF) | ((m->Memory[0x1F4] & 0x0F)<<8);
+	m->ChB = (m->Memory[0x01F1] & 0xFF) | ((m->Memory[0x1F5] & 0x0F)<<8);
+	m->ChC = (m->Memory[0x01F2] & 0xFF) | ((m->Memory[0x1F6] & 0x0F)<<8);
  
-    ChA = ChA + (0x1000 * (ChA==0)); // a Channel Period value of 0
-    ChB = ChB + (0x1000 * (ChB==0)); // indicates a value of 0x1000
-    ChC = ChC + (0x1000 * (ChC==0));
+    m->ChA = m->ChA + (0x1000 * (m->ChA==0)); // a Channel Period value of 0
+    m->ChB = m->ChB + (0x1000 * (m->ChB==0)); // indicates a value of 0x1000
+    m->ChC = m->ChC + (0x1000 * (m->ChC==0));
 
-    NoiseP = (Memory[0x01F9] & 0x1F)<<1;
+    m->NoiseP = (m->Memory[0x01F9] & 0x1F)<<1;
 
     // a Noise Period of 0 indicates a period of 0x40
-    NoiseP = NoiseP + (0x40 * (NoiseP==0));
+    m->NoiseP = m->NoiseP + (0x40 * (m->NoiseP==0));
 
-    EnvP = ((Memory[0x01F3] & 0xFF) | ((Memory[0x1F7] & 0xFF)<<8))<<1;
+    m->EnvP = ((m->Memory[0x01F3] & 0xFF) | ((m->Memory[0x1F7] & 0xFF)<<8))<<1;
 
     // an Envelope Period of 0 indicates a period of 0x20000
-    EnvP = EnvP + (0x20000 * (EnvP==0));
+    m->EnvP = m->EnvP + (0x20000 * (m->EnvP==0));
 
 	// Envelope Flags
-	EnvContinue = (EnvFlags>>3) & 0x01;
-	EnvAttack = (EnvFlags>>2) & 0x01;
-	EnvAlternate = (EnvFlags>>1) & 0x01;
-	EnvHold = EnvFlags & 0x01;
+	m->EnvContinue = (EnvFlags>>3) & 0x01;
+	m->EnvAttack = (EnvFlags>>2) & 0x01;
+	m->EnvAlternate = (EnvFlags>>1) & 0x01;
+	m->EnvHold = EnvFlags & 0x01;
 }
 
-void PSGInit()
+void PSGInit(intv_machine *m)
 {
-	PSGBufferSize = 7467; // set in psg.h
-
-	OutA = 0; // tone generator outputs
-	OutB = 0;
-	OutC = 0;
-	OutN = 0x10004; // noise output
-	OutE = 0; // envelope output
-	CountA = 0; // tone generator countdowns
-	CountB = 0;
-	CountC = 0;
-	CountN = 0; // noise generator countdown
-	CountE = 0; // envelope countdown
-	readRegisters();
+	m->PSGBufferSize = 7467; // set in psg.h
+
+	m->OutA = 0; // tone generator outputs
+	m->OutB = 0;
+	m->OutC = 0;
+	m->OutN = 0x10004; // noise output
+	m->OutE = 0; // envelope output
+	m->CountA = 0; // tone generator countdowns
+	m->CountB = 0;
+	m->CountC = 0;
+	m->CountN = 0; // noise generator countdown
+	m->CountE = 0; // envelope countdown
+	readRegisters(m);
 }
 
-void PSGFrame()
+void PSGFrame(intv_machine *m)
 {
-	PSGBufferPos = 0;
+	m->PSGBufferPos = 0;
  #if 0  // Debugging
     {
-        fprintf(stderr, "%04x %04x %04x %02x %02x %02x\n", ChA, ChB, ChC, VolA, VolB, VolC);
+        fprintf(stderr, "%04x %04x %04x %02x %02x %02x\n", m->ChA, m->ChB, m->ChC, VolA, VolB, VolC);
     }
  #endif
 }
@@ -198,92 +187,92 @@ int psg_masks[16] = {
     0x3f, 0x3f, 0xff, 0xff,
 };
 
-void PSGNotify(int adr, int val) // PSG Registers Modified 0x01F0-0x1FD (called from writeMem)
+void PSGNotify(intv_machine *m, int adr, int val) // PSG Registers Modified 0x01F0-0x1FD (called from writeMem)
 {
-    Memory[adr] &= psg_masks[adr - 0x1f0];
-	readRegisters();
+    m->Memory[adr] &= psg_masks[adr - 0x1f0];
+	readRegisters(m);
     // Note: updating frequencies doesn't reset counters in real chip
     //       (otherwise sound glitch happens in games)
 
 	// Envelope properties Trigger (write only register)
 	if (adr==0x1FA)  
 	{ 
-		CountE = EnvP;
-		StepE = 0;
+		m->CountE = m->EnvP;
+		m->StepE = 0;
 
-		if (EnvAttack) // attack __/|/|/|___
+		if (m->EnvAttack) // attack __/|/|/|___
 		{
-			OutE = 0;
-			StepE = 1;
+			m->OutE = 0;
+			m->StepE = 1;
 		}
 		else
 		{
-			OutE = 15;
-			StepE = -1;
+			m->OutE = 15;
+			m->StepE = -1;
 		}
 	}
 }
 
-void PSGTick(int ticks) // adds 1 sound sample per 4 cpu cycles to the buffer
+void PSGTick(intv_machine *m, int ticks) // adds 1 sound sample per 4 cpu cycles to the buffer
 {
 	int16_t sample;
 	int a, b, c;
 
-	Ticks = Ticks + ticks;
+	m->Ticks = m->Ticks + ticks;
 
-	while(Ticks >= 4)
+	while(m->Ticks >= 4)
 	{
-		Ticks -= 4;
+		m->Ticks -= 4;
 
-		CountA--;
-		CountB--;
-		CountC--;
-		CountN--;
-		CountE--;
+		m->CountA--;
+		m->CountB--;
+		m->CountC--;
+		m->CountN--;
+		m->CountE--;
 
 		/* ************** Generate Sample ************** */
 
-		OutA = OutA ^ (CountA<=0); // Tone Generators
-		OutB = OutB ^ (CountB<=0); 
-		OutC = OutC ^ (CountC<=0); 
+		m->OutA = m->OutA ^ (m->CountA<=0); // Tone Generators
+		m->OutB = m->OutB ^ (m->CountB<=0); 
+		m->OutC = m->OutC ^ (m->CountC<=0); 
 
 		// http://spatula-city.org/~im14u2c/intv/jzintv-1.0-beta3/doc/programming/psg.txt
-		if(CountE==0) // Envelope Generator 
+		if(m->CountE==0) // Envelope Generator 
 		{
-			CountE = EnvP; // reset countdown
-			OutE = OutE + StepE; // step up, step down, or hold
+			m->CountE = m->EnvP; // reset countdown
+			m->OutE = m->OutE + m->StepE; // step up, step down, or hold
 
-			if(StepE != 0 && (OutE>15 || OutE<0)) // we've reached the top or bottom
+			if(m->StepE != 0 && (m->OutE>15 || m->OutE<0)) // we've reached the top or bottom
 			{
-				if(EnvHold)
+				if(m->EnvHold)
 				{ 
-					StepE = 0; // stop changing (hold volume)
-					if(EnvAlternate) // alternate & hold  1011 1111
+					m->StepE = 0; // stop changing (hold volume)
+					if(m->EnvAlternate) // alternate & hold  1011 1111
 					{
-						OutE = 15 * (EnvAttack==0);
+						m->OutE = 15 * (m->EnvAttack==0);
 					}
 					else // hold at 0 (1001) or 15 (1101) 
 					{
-						OutE = 15 * (EnvAttack==1);
+						m->OutE = 15 * (m->EnvAttack==1);
 					}
 				}
 				else
 				{
-					if(EnvAlternate) // triange waves__/\/\/\__ 1010  \/\/\/\___ 1110
+					if(m->EnvAlternate) // triange waves__/\/\/\__ 1010  \/\/\/\___ 1110
 					{
-						StepE = StepE * -1;    // Swap step direction
-						OutE = (OutE + StepE) & 0x0F;
+						m->StepE = m->StepE * -1;    // Swap step direction
+						m->OutE = (m->OutE + m->StepE) & 0x0F;
 					}
 					else // saw-tooth waves __|\|\|\__ 1000 ___/|/|/|___ 1100
 					{
-						OutE = 15 * (EnvAttack==0);
+						m->OutE = 15 * (m->EnvAttack==0);
 					}
 				}
 				// Anything without continue flag set holds at 0
-				if(EnvContinue==0)
+				if(m->EnvContinue==0)
 				{
-					OutE = 0;
-					StepE = 0;
+					m->OutE = 0;
+					m->StepE = 0;
 				}
 			}
 		}
@@ -292,34 +281,34 @@ void PSGTick(int ticks) // adds 1 sound sample per 4 cpu cycles to the buffer
 		// noise = (noise >> 1) ^ ((noise & 1) ? 0x14000 : 0);
         // The wiki is wrong as MAME says the LFSR noise is
         // bit 0 + bit 3 so the correct mask is 0x10004
-		if(CountN<=0)
+		if(m->CountN<=0)
 		{
-			CountN = NoiseP;
-			OutN = (OutN >> 1) ^ ((OutN & 1) * 0x10004); // Noise Generator
+			m->CountN = m->NoiseP;
+			m->OutN = (m->OutN >> 1) ^ ((m->OutN & 1) * 0x10004); // Noise Generator
 		}
 
 		// http://wiki.intellivision.us/index.php?title=PSG
 		// channel_output = (noise_enable OR noise_generator_output) AND (tone_enable OR tone_generator_output)
-		a = (NoiseA | (OutN & 1)) & (ToneA | OutA); // Generate Sample for each channel
-		b = (NoiseB | (OutN & 1)) & (ToneB | OutB);
-		c = (NoiseC | (OutN & 1)) & (ToneC | OutC);
+		a = (NoiseA | (m->OutN & 1)) & (ToneA | m->OutA); // Generate Sample for each channel
+		b = (NoiseB | (m->OutN & 1)) & (ToneB | m->OutB);
+		c = (NoiseC | (m->OutN & 1)) & (ToneC | m->OutC);
 
 		// Adjust amplitude (Volume / Envelope)
-		a = a * ( (Volume[VolA] * (EnvA==0)) | (Volume[OutE >> Envelope_Shift[EnvA]]) );
-		b = b * ( (Volume[VolB] * (EnvB==0)) | (Volume[OutE >> Envelope_Shift[EnvB]]) );
-		c = c * ( (Volume[VolC] * (EnvC==0)) | (Volume[OutE >> Envelope_Shift[EnvC]]) );
+		a = a * ( (Volume[VolA] * (EnvA==0)) | (Volume[m->OutE >> Envelope_Shift[EnvA]]) );
+		b = b * ( (Volume[VolB] * (EnvB==0)) | (Volume[m->OutE >> Envelope_Shift[EnvB]]) );
+		c = c * ( (Volume[VolC] * (EnvC==0)) | (Volume[m->OutE >> Envelope_Shift[EnvC]]) );
 
 		sample = a + b + c;
 
 		/* ********************************************* */
 
-		CountA += ChA * (CountA<=0); // reset countdowns when they reach 0 
-		CountB += ChB * (CountB<=0);
-		CountC += ChC * (CountC<=0);
+		m->CountA += m->ChA * (m->CountA<=0); // reset countdowns when they reach 0 
+		m->CountB += m->ChB * (m->CountB<=0);
+		m->CountC += m->ChC * (m->CountC<=0);
 
-		PSGBuffer[PSGBufferPos] = sample; // write sample to buffer
+		m->PSGBuffer[m->PSGBufferPos] = sample; // write sample to buffer
 		
-		PSGBufferPos++;
-		PSGBufferPos = PSGBufferPos * (PSGBufferPos < 7467); // wrap to beginning
+		m->PSGBufferPos++;
+		m->PSGBufferPos = m->PSGBufferPos * (m->PSGBufferPos < 7467); // wrap to beginning
 	}
 }
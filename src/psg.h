@@ -18,16 +18,11 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include <stdint.h>
-
-// Circular Buffer holds up to two frames:
-extern int16_t PSGBuffer[7467]; // 14934 cpu cycles/frame ; 3733.5 psg cycles/frame
-extern int PSGBufferPos; // points to next location in output buffer
-extern int PSGBufferSize;
+#include "intv.h"
 
 struct PSGserialized {
     int PSGBufferSize;
-    int16_t PSGBuffer[7467];
-    int PSGBufferPos;
+    int PSGBufferPos; // PSGBuffer is saved up to here by PSGSerializeBuffer
     
     int Ticks; // CPU cycles not yet processed
     
@@ -58,13 +53,16 @@ struct PSGserialized {
     int EnvHold;
 };
 
-void PSGSerialize(struct PSGserialized *);
-void PSGUnserialize(const struct PSGserialized *);
+void PSGSerialize(intv_machine *m, struct PSGserialized *);
+void PSGUnserialize(intv_machine *m, const struct PSGserialized *);
+int PSGSerializeBuffer(intv_machine *m, int16_t *data); // returns samples written
+int PSGCheckBuffer(const struct PSGserialized *all, int size); // samples saved with all, -1 if they don't fit in size
+int PSGUnserializeBuffer(intv_machine *m, const int16_t *data); // after PSGUnserialize of a checked state
 
-void PSGInit(void); 
-void PSGFrame(void); // Notify New Frame
-void PSGTick(int ticks); // ticks PSG some number of cpu cycles 
-void PSGNotify(int adr, int val); // updates PSG on register change
+void PSGInit(intv_machine *m); 
+void PSGFrame(intv_machine *m); // Notify New Frame
+void PSGTick(intv_machine *m, int ticks); // ticks PSG some number of cpu cycles 
+void PSGNotify(intv_machine *m, int adr, int val); // updates PSG on register change
 
 
 #endif
@@ -0,0 +1,235 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "intv.h"
+#include "rewind.h"
+
+// The ring holds one delta per frame, newest at head, each stored as
+// [length][words][length] with 32-bit lengths split in two words, so it can
+// be popped from the newest end and dropped from the oldest end.
+struct rewind_buffer {
+	uint16_t *ring;
+	size_t size;       // ring size in words
+	size_t head;       // where the next delta goes
+	size_t used;       // words in the ring
+	int frames;        // deltas in the ring
+
+	size_t stateWords; // IntvSerializeSize in words
+	uint16_t *current; // newest state
+	uint16_t *next;    // the state being pushed
+	uint16_t *delta;   // encoded delta, up to 2*stateWords+4 words
+};
+
+rewind_buffer *RewindCreate(size_t budget)
+{
+	rewind_buffer *rb = (rewind_buffer *) calloc(1, sizeof(rewind_buffer));
+
+	if(rb == NULL) { return NULL; }
+	rb->size = budget / sizeof(uint16_t);
+	rb->ring = (uint16_t *) malloc(rb->size * sizeof(uint16_t));
+	if(rb->ring == NULL)
+	{
+		free(rb);
+		return NULL;
+	}
+	return rb;
+}
+
+void RewindDestroy(rewind_buffer *rb)
+{
+	if(rb == NULL) { return; }
+	free(rb->ring);
+	free(rb->current);
+	free(rb->next);
+	free(rb->delta);
+	free(rb);
+}
+
+void RewindClear(rewind_buffer *rb)
+{
+	rb->head = 0;
+	rb->used = 0;
+	rb->frames = 0;
+	rb->stateWords = 0; // no current state either
+}
+
+int RewindFrames(rewind_buffer *rb)
+{
+	return rb->frames;
+}
+
+// XOR of two states as runs: [zero words][literal words][literals], with
+// runs of fewer than 3 zero words kept in the literals.  Returns the length.
+size_t encodeDelta(const uint16_t *a, const uint16_t *b, size_t words, uint16_t *out)
+{
+	size_t i = 0, n = 0, zeros, start, lit, run;
+
+	while(i < words)
+	{
+		zeros = 0;
+		while(i < words && a[i] == b[i] && zeros < 0xFFFF) { i++; zeros++; }
+		start = i;
+		lit = 0;
+		while(i < words && lit < 0xFFFF)
+		{
+			// stop the literals at a run of 3 equal words
+			for(run=0; run<3 && i+run < words && a[i+run] == b[i+run]; run++) { }
+			if(run == 3 || i+run == words) { break; }
+			i += run + 1;
+			lit += run + 1;
+		}
+		if(lit > 0xFFFF) // the last step may overshoot
+		{
+			i -= lit - 0xFFFF;
+			lit = 0xFFFF;
+		}
+		out[n++] = zeros;
+		out[n++] = lit;
+		for(; lit > 0; lit--, start++)
+		{
+			out[n++] = a[start] ^ b[start];
+		}
+	}
+	return n;
+}
+
+// state ^= delta, turns the newer state back into the older one
+void applyDelta(uint16_t *state, const uint16_t *delta, size_t length)
+{
+	size_t i = 0, n = 0, lit;
+
+	while(n < length)
+	{
+		i += delta[n++];
+		lit = delta[n++];
+		for(; lit > 0; lit--)
+		{
+			state[i++] ^= delta[n++];
+		}
+	}
+}
+
+void ringPut(rewind_buffer *rb, size_t pos, uint16_t word)
+{
+	rb->ring[pos % rb->size] = word;
+}
+
+uint16_t ringGet(rewind_buffer *rb, size_t pos)
+{
+	return rb->ring[pos % rb->size];
+}
+
+size_t ringLength(rewind_buffer *rb, size_t pos)
+{
+	return ringGet(rb, pos) | ((size_t) ringGet(rb, pos + 1) << 16);
+}
+
+void dropOldest(rewind_buffer *rb)
+{
+	size_t tail = rb->head + rb->size - rb->used;
+	size_t length = ringLength(rb, tail);
+
+	rb->used -= length + 4;
+	rb->frames--;
+}
+
+int allocStates(rewind_buffer *rb, size_t words)
+{
+	free(rb->current);
+	free(rb->next);
+	free(rb->delta);
+	rb->current = (uint16_t *) malloc(words * sizeof(uint16_t));
+	rb->next = (uint16_t *) malloc(words * sizeof(uint16_t));
+	rb->delta = (uint16_t *) malloc((2 * words + 4) * sizeof(uint16_t));
+	if(rb->current == NULL || rb->next == NULL || rb->delta == NULL)
+	{
+		return 0;
+	}
+	return 1;
+}
+
+void RewindPush(rewind_buffer *rb, intv_machine *m)
+{
+	size_t words = IntvSerializeSize(m) / sizeof(uint16_t);
+	size_t used, length, i;
+	uint16_t *t;
+
+	if(words != rb->stateWords) // first frame, or another game
+	{
+		RewindClear(rb);
+		if(!allocStates(rb, words)) { return; }
+		used = IntvSerialize(m, rb->current, words * sizeof(uint16_t));
+		memset((unsigned char *) rb->current + used, 0, words * sizeof(uint16_t) - used);
+		rb->stateWords = words;
+		return;
+	}
+
+	// the unused end is zeroed so it doesn't show up in the delta
+	used = IntvSerialize(m, rb->next, words * sizeof(uint16_t));
+	memset((unsigned char *) rb->next + used, 0, words * sizeof(uint16_t) - used);
+	length = encodeDelta(rb->current, rb->next, words, rb->delta);
+
+	t = rb->current;
+	rb->current = rb->next;
+	rb->next = t;
+
+	if(length + 4 > rb->size) // can't keep even one frame
+	{
+		rb->head = rb->used = rb->frames = 0;
+		return;
+	}
+	while(rb->used + length + 4 > rb->size)
+	{
+		dropOldest(rb);
+	}
+	ringPut(rb, rb->head, length & 0xFFFF);
+	ringPut(rb, rb->head + 1, length >> 16);
+	for(i=0; i<length; i++)
+	{
+		ringPut(rb, rb->head + 2 + i, rb->delta[i]);
+	}
+	ringPut(rb, rb->head + 2 + length, length & 0xFFFF);
+	ringPut(rb, rb->head + 3 + length, length >> 16);
+	rb->head = (rb->head + length + 4) % rb->size;
+	rb->used += length + 4;
+	rb->frames++;
+}
+
+int RewindStep(rewind_buffer *rb, intv_machine *m)
+{
+	size_t start, length, i;
+
+	if(rb->frames == 0 || rb->stateWords == 0)
+	{
+		return 0;
+	}
+	length = ringLength(rb, rb->head + rb->size - 2);
+	start = rb->head + rb->size - length - 4;
+	for(i=0; i<length; i++)
+	{
+		rb->delta[i] = ringGet(rb, start + 2 + i);
+	}
+	rb->head = start % rb->size;
+	rb->used -= length + 4;
+	rb->frames--;
+
+	applyDelta(rb->current, rb->delta, length);
+	return IntvUnserialize(m, rb->current, rb->stateWords * sizeof(uint16_t));
+}
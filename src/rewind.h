@@ -0,0 +1,42 @@
+#ifndef REWIND_H
+#define REWIND_H
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stddef.h>
+#include "intv.h"
+
+// Rewind history.  RewindPush saves the machine after each frame with
+// IntvSerialize and keeps, for every older frame, the XOR with the state
+// after it, run-length coded.  Unchanged memory costs almost nothing, and
+// the oldest frames are dropped to stay within the budget.
+typedef struct rewind_buffer rewind_buffer;
+
+rewind_buffer *RewindCreate(size_t budget); // budget in bytes for the deltas, NULL if out of memory
+
+void RewindDestroy(rewind_buffer *rb);
+
+void RewindClear(rewind_buffer *rb); // forget all frames, e.g. after loading a game
+
+void RewindPush(rewind_buffer *rb, intv_machine *m); // call between frames
+
+int RewindStep(rewind_buffer *rb, intv_machine *m); // restore the previous frame, returns 0 when there is none
+
+int RewindFrames(rewind_buffer *rb); // how many frames RewindStep can go back
+
+#endif
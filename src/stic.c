@@ -17,48 +17,43 @@
 */
 
 #include "intv.h"
+#include "machine.h"
 #include "memory.h"
 #include "stic.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <retro_inline.h>
+
+#if defined(HAVE_STIC_THREAD)
+#include <pthread.h>
+#endif
+
+// Vector palette kernels for STICFrameToRGB, build with NO_STIC_SIMD to
+// keep only the plain C one.  x86 picks SSSE3 or AVX2 at run time, NEON
+// builds (all of AArch64, -mfpu=neon on ARMv7) always use it.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(NO_STIC_SIMD)
+#define STIC_SIMD_X86
+#include <immintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN) && !defined(NO_STIC_SIMD)
+#define STIC_SIMD_NEON
+#include <arm_neon.h>
+#endif
 
 void drawBackground(void);
-void drawSprites(int scanline);
-void drawBorder(int scanline);
-void drawBackgroundFGBG(int scanline);
-void drawBackgroundColorStack(int scanline);
+int drawSprites(const struct STICinput *in, struct STICrender *r, int scanline);
+void drawBorder(const struct STICinput *in, struct STICrender *r, int scanline);
+void drawBackgroundFGBG(const struct STICinput *in, struct STICrender *r, int scanline);
+void drawBackgroundColorStack(const struct STICinput *in, struct STICrender *r, int scanline);
+void drawRow(const struct STICinput *in, struct STICrender *r, int row);
+void frameDelays(intv_machine *m);
 
 // Video chip: TMS9927 AY-3-8900-1
 // http://spatula-city.org/~im14u2c/intv/jzintv-1.0-beta3/doc/programming/stic.txt
 // http://spatula-city.org/~im14u2c/intv/tech/master.html
 
-unsigned int STICMode;
-
-int stic_phase;
-int stic_vid_enable;
-int stic_reg;
-int stic_gram;
-int phase_len;
-
-int DisplayEnabled;
-
-unsigned int frame[352*224];
-
-unsigned int scanBuffer[768]; // buffer for current scanline (352+32)*2
-unsigned int collBuffer[768]; // buffer for collision -- made larger than needed to save checks
-
-int delayH = 0; // Horizontal Delay
-int delayV = 0; // Vertical Delay
-
-int extendTop = 0;
-int extendLeft = 0;
-
-unsigned int CSP; // Color Stack Pointer
-unsigned int fgcard[20]; // cached colors for cards on current row
-unsigned int bgcard[20]; // (used for normal color stack mode)
 #if defined(ABGR1555)
-unsigned int color7 = 0xFFFCFF; // Copy of color 7 (for color squares mode)
 unsigned int colors[16] =
 {
 	0x05000C, /* 0x000000; */ // Black
@@ -79,7 +74,6 @@ unsigned int colors[16] =
 	0x7D1AC8  /* 0xFF007F; */ // Magenta
 };
 #else
-unsigned int color7 = 0xFFFCFF; // Copy of color 7 (for color squares mode)
 unsigned int colors[16] =
 {
 	0x0C0005, /* 0x000000; */ // Black
@@ -121,119 +115,385 @@ int reverse[256] = // lookup table to reverse the bits in a byte //
 	0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
 };
 
-void STICSerialize(struct STICserialized *all)
-{
-    all->STICMode = STICMode;
-    all->stic_phase = stic_phase;
-    all->stic_vid_enable = stic_vid_enable;
-    all->stic_reg = stic_reg;
-    all->stic_gram = stic_gram;
-    all->phase_len = phase_len;
-    all->DisplayEnabled = DisplayEnabled;
-    all->delayH = delayH;
-    all->delayV = delayV;
-    all->extendTop = extendTop;
-    all->extendLeft = extendLeft;
-    all->CSP = CSP;
-    memcpy(all->fgcard, fgcard, sizeof(fgcard));
-    memcpy(all->bgcard, bgcard, sizeof(bgcard));
-    memcpy(all->frame, frame, sizeof(frame));
-}
-
-void STICUnserialize(const struct STICserialized *all)
-{
-    STICMode = all->STICMode;
-    stic_phase = all->stic_phase;
-    stic_vid_enable = all->stic_vid_enable;
-    stic_reg = all->stic_reg;
-    stic_gram = all->stic_gram;
-    phase_len = all->phase_len;
-    DisplayEnabled = all->DisplayEnabled;
-    delayH = all->delayH;
-    delayV = all->delayV;
-    extendTop = all->extendTop;
-    extendLeft = all->extendLeft;
-    CSP = all->CSP;
-    memcpy(fgcard, all->fgcard, sizeof(fgcard));
-    memcpy(bgcard, all->bgcard, sizeof(bgcard));
-    memcpy(frame, all->frame, sizeof(frame));
-}
-
-void STICReset(void)
-{
-	STICMode = 1;       // Color Stack mode
-	SR1 = 0;            // No interrupt pending
-	DisplayEnabled = 0;
-	CSP = 0x28;
-    stic_phase = 15;
-    stic_reg = 1;
-    stic_gram = 1;
-    phase_len = 2782;   // Time to run before the first STIC interrupt
-}
-
-void drawBorder(int scanline)
+void STICSerialize(intv_machine *m, struct STICserialized *all)
+{
+    STICFinishFrame(m);
+    all->STICMode = m->STICMode;
+    all->stic_phase = m->stic_phase;
+    all->stic_vid_enable = m->stic_vid_enable;
+    all->stic_reg = m->stic_reg;
+    all->stic_gram = m->stic_gram;
+    all->phase_len = m->phase_len;
+    all->DisplayEnabled = m->DisplayEnabled;
+    all->delayH = m->delayH;
+    all->delayV = m->delayV;
+    all->extendTop = m->extendTop;
+    all->extendLeft = m->extendLeft;
+    all->CSP = m->render.CSP;
+    memcpy(all->fgcard, m->render.fgcard, sizeof(m->render.fgcard));
+    memcpy(all->bgcard, m->render.bgcard, sizeof(m->render.bgcard));
+}
+
+void STICUnserialize(intv_machine *m, const struct STICserialized *all)
+{
+    STICFinishFrame(m);
+    m->STICMode = all->STICMode;
+    m->stic_phase = all->stic_phase;
+    m->stic_vid_enable = all->stic_vid_enable;
+    m->stic_reg = all->stic_reg;
+    m->stic_gram = all->stic_gram;
+    m->phase_len = all->phase_len;
+    m->DisplayEnabled = all->DisplayEnabled;
+    m->delayH = all->delayH;
+    m->delayV = all->delayV;
+    m->extendTop = all->extendTop;
+    m->extendLeft = all->extendLeft;
+    m->render.CSP = all->CSP;
+    memcpy(m->render.fgcard, all->fgcard, sizeof(m->render.fgcard));
+    memcpy(m->render.bgcard, all->bgcard, sizeof(m->render.bgcard));
+}
+
+void STICReset(intv_machine *m)
+{
+	STICFinishFrame(m);
+	m->STICMode = 1;       // Color Stack mode
+	m->SR1 = 0;            // No interrupt pending
+	m->DisplayEnabled = 0;
+	m->render.CSP = 0x28;
+    m->stic_phase = 15;
+    m->stic_reg = 1;
+    m->stic_gram = 1;
+    m->phase_len = 2782;   // Time to run before the first STIC interrupt
+}
+
+// Sets bits of a collision line mask at x, bit 0 of bits is column x
+static INLINE void maskBits(uint64_t *mask, int x, uint64_t bits)
+{
+	mask[x>>6] |= bits << (x&63);
+	if(x&63) { mask[(x>>6)+1] |= bits >> (64-(x&63)); }
+}
+
+// Sets columns from to to-1 of a collision line mask
+static INLINE void maskRange(uint64_t *mask, int from, int to)
+{
+	int n;
+
+	for(; from<to; from+=n)
+	{
+		n = 64 - (from&63);
+		if(n > to-from) { n = to-from; }
+		mask[from>>6] |= (n==64 ? ~0ULL : (1ULL<<n)-1) << (from&63);
+	}
+}
+
+// Columns 1 to 167 of a collision line mask, the only ones that latch
+static const uint64_t CollColumns[3] = { ~1ULL, ~0ULL, (1ULL<<40)-1 };
+
+void drawBorder(const struct STICinput *in, struct STICrender *r, int scanline)
 {
 	int i;
-	int cbit = 1<<9; // bit 9 - border collision 
-	int color = colors[Memory[0x2C] & 0x0f]; // border color
+	uint64_t *mask = r->collMask[9][0]; // border collision, line 0
+	int color = in->stack[0x2C-0x28] & 0x0f; // border color
 	
 	if(scanline>=112) { return; }
-    if (scanline == delayV - 1 || scanline == 104 || extendTop != 0 && scanline >= 7 && scanline < 16) {    // Collision border is 1 pixel thick, or 9 if extendTop is set
-        for(i=1 * 2; i < (8 + 160) * 2; i += 2)         // It extends from column -7 to 159
-        {
-            collBuffer[i] |= cbit;
-            collBuffer[i+384] |= cbit;
-        }
-    } else if (scanline > delayV - 1 && scanline < 104) {   // Left and right side collision border
-        for(i=1 * 2; i < 16+(16*extendLeft); i += 2)                 // Left side from column -7 to -1 (or 7 if extendLeft is set)
-        {
-            collBuffer[i] |= cbit;
-            collBuffer[i+384] |= cbit;
-        }
-        i = (8 + 159) * 2;                              // Right side collision is 1 pixel thick
-        collBuffer[i] |= cbit;
-        collBuffer[i + 384] |= cbit;
+    if (scanline == in->delayV - 1 || scanline == 104 || in->extendTop != 0 && scanline >= 7 && scanline < 16) {    // Collision border is 1 pixel thick, or 9 if extendTop is set
+        maskRange(mask, 1, 8 + 160);                    // It extends from column -7 to 159
+    } else if (scanline > in->delayV - 1 && scanline < 104) {   // Left and right side collision border
+        maskRange(mask, 1, 8+(8*in->extendLeft));       // Left side from column -7 to -1 (or 7 if extendLeft is set)
+        maskRange(mask, 8 + 159, 8 + 160);              // Right side collision is 1 pixel thick
     }
-    if (extendTop != 0)
+    memcpy(r->collMask[9][1], mask, sizeof(r->collMask[9][1]));
+    if (in->extendTop != 0)
         i = 16;
     else
-        i = delayV;
+        i = in->delayV;
     if(scanline<i || scanline>=104) // top and bottom border
 	{
-		for(i=0; i<352; i++)
+		memset(&r->scanBuffer[0], color, 176);
+		memset(&r->scanBuffer[192], color, 176);
+	}
+	else // left and right border
+	{
+		i = 8+(8*in->extendLeft);
+		memset(&r->scanBuffer[0], color, i);
+		memset(&r->scanBuffer[168], color, i);
+		memset(&r->scanBuffer[192], color, i);
+		memset(&r->scanBuffer[192+168], color, i);
+        r->scanBuffer[167] = color;                    // Invisible 160th column
+        r->scanBuffer[167 + 192] = color;
+    }
+}
+
+// Card graphic bytes expanded to 8 pixels, 0xFF where the bit is set.
+// Indexed by the byte itself, so GRAM writes never leave a stale entry.
+static uint8_t CardMask[256][8];
+
+// Bits of a byte doubled, for double width MOBs
+static uint16_t DoubleBits[256];
+
+#define PIXELS8 0x0101010101010101ULL // times a color, 8 pixels of it
+
+// Converts count colors[] indices to pixels, twice each when doubled
+typedef void (*expandFunc)(unsigned int *out, const uint8_t *in, int count, int doubled, const uint8_t planes[4][16]);
+
+static void expandScalar(unsigned int *out, const uint8_t *in, int count, int doubled, const uint8_t planes[4][16])
+{
+	int i;
+
+	(void) planes; // reads colors[] directly
+
+	if(doubled)
+	{
+		for(i=0; i<count; i++)
 		{
-			scanBuffer[i] = color;
-			scanBuffer[i+384] = color;
+			out[i*2] = out[i*2+1] = colors[in[i]];
 		}
+		return;
 	}
-	else // left and right border
+	for(i=0; i<count; i++)
 	{
-		for(i=0; i<16+(16*extendLeft); i++)
+		out[i] = colors[in[i]];
+	}
+}
+
+// The vector kernels look colors[] up as four byte planes, 16 entries
+// fit a register and a byte shuffle does 16 (or 32) lookups at once.
+static void colorPlanes(uint8_t planes[4][16])
+{
+	int i, k;
+
+	for(k=0; k<4; k++)
+	{
+		for(i=0; i<16; i++)
 		{
-			scanBuffer[i] = color;
-			scanBuffer[i+168*2] = color;
-			scanBuffer[i+384] = color;
-			scanBuffer[i+384+168*2] = color;
+			planes[k][i] = (colors[i] >> (8*k)) & 0xFF;
 		}
-        scanBuffer[167*2] = color;                  // Invisible 160th column
-        scanBuffer[167*2 + 1] = color;
-        scanBuffer[167*2 + 384] = color;                  // Invisible 160th column
-        scanBuffer[167*2 + 384 + 1] = color;
-    }
+	}
+}
+
+#ifdef STIC_SIMD_X86
+// 16 indices to 16 pixels
+__attribute__((target("ssse3")))
+static INLINE void lookupSSSE3(unsigned int *out, __m128i idx, const __m128i *planes)
+{
+	__m128i b0 = _mm_shuffle_epi8(planes[0], idx);
+	__m128i b1 = _mm_shuffle_epi8(planes[1], idx);
+	__m128i b2 = _mm_shuffle_epi8(planes[2], idx);
+	__m128i b3 = _mm_shuffle_epi8(planes[3], idx);
+	__m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+	__m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+	__m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+	__m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+
+	_mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *) (out + 4), _mm_unpackhi_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *) (out + 8), _mm_unpacklo_epi16(hi01, hi23));
+	_mm_storeu_si128((__m128i *) (out + 12), _mm_unpackhi_epi16(hi01, hi23));
+}
+
+__attribute__((target("ssse3")))
+static void expandSSSE3(unsigned int *out, const uint8_t *in, int count, int doubled, const uint8_t table[4][16])
+{
+	__m128i planes[4];
+	__m128i idx;
+	int i, k;
+
+	for(k=0; k<4; k++)
+	{
+		planes[k] = _mm_loadu_si128((const __m128i *) table[k]);
+	}
+	if(doubled)
+	{
+		for(i=0; i+8<=count; i+=8)
+		{
+			idx = _mm_loadl_epi64((const __m128i *) (in + i));
+			lookupSSSE3(out + i*2, _mm_unpacklo_epi8(idx, idx), planes);
+		}
+		expandScalar(out + i*2, in + i, count - i, 1, table);
+		return;
+	}
+	for(i=0; i+16<=count; i+=16)
+	{
+		lookupSSSE3(out + i, _mm_loadu_si128((const __m128i *) (in + i)), planes);
+	}
+	expandScalar(out + i, in + i, count - i, 0, table);
+}
+
+// 32 indices to 32 pixels, the shuffles and unpacks work on each 128-bit
+// half, so the last step puts the halves back in order
+__attribute__((target("avx2")))
+static INLINE void lookupAVX2(unsigned int *out, __m256i idx, const __m256i *planes)
+{
+	__m256i b0 = _mm256_shuffle_epi8(planes[0], idx);
+	__m256i b1 = _mm256_shuffle_epi8(planes[1], idx);
+	__m256i b2 = _mm256_shuffle_epi8(planes[2], idx);
+	__m256i b3 = _mm256_shuffle_epi8(planes[3], idx);
+	__m256i lo01 = _mm256_unpacklo_epi8(b0, b1);
+	__m256i hi01 = _mm256_unpackhi_epi8(b0, b1);
+	__m256i lo23 = _mm256_unpacklo_epi8(b2, b3);
+	__m256i hi23 = _mm256_unpackhi_epi8(b2, b3);
+	__m256i p0 = _mm256_unpacklo_epi16(lo01, lo23); // pixels 0-3, 16-19
+	__m256i p1 = _mm256_unpackhi_epi16(lo01, lo23); // 4-7, 20-23
+	__m256i p2 = _mm256_unpacklo_epi16(hi01, hi23); // 8-11, 24-27
+	__m256i p3 = _mm256_unpackhi_epi16(hi01, hi23); // 12-15, 28-31
+
+	_mm256_storeu_si256((__m256i *) out, _mm256_permute2x128_si256(p0, p1, 0x20));
+	_mm256_storeu_si256((__m256i *) (out + 8), _mm256_permute2x128_si256(p2, p3, 0x20));
+	_mm256_storeu_si256((__m256i *) (out + 16), _mm256_permute2x128_si256(p0, p1, 0x31));
+	_mm256_storeu_si256((__m256i *) (out + 24), _mm256_permute2x128_si256(p2, p3, 0x31));
+}
+
+__attribute__((target("avx2")))
+static void expandAVX2(unsigned int *out, const uint8_t *in, int count, int doubled, const uint8_t table[4][16])
+{
+	__m256i planes[4];
+	__m128i idx;
+	int i, k;
+
+	for(k=0; k<4; k++)
+	{
+		planes[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) table[k]));
+	}
+	if(doubled)
+	{
+		for(i=0; i+16<=count; i+=16)
+		{
+			idx = _mm_loadu_si128((const __m128i *) (in + i));
+			lookupAVX2(out + i*2, _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(idx, idx)),
+				_mm_unpackhi_epi8(idx, idx), 1), planes);
+		}
+		expandScalar(out + i*2, in + i, count - i, 1, table);
+		return;
+	}
+	for(i=0; i+32<=count; i+=32)
+	{
+		lookupAVX2(out + i, _mm256_loadu_si256((const __m256i *) (in + i)), planes);
+	}
+	expandScalar(out + i, in + i, count - i, 0, table);
+}
+#endif
+
+#ifdef STIC_SIMD_NEON
+static INLINE uint8x16_t tableNEON(uint8x16_t table, uint8x16_t idx)
+{
+#if defined(__aarch64__)
+	return vqtbl1q_u8(table, idx);
+#else
+	uint8x8x2_t t;
+
+	t.val[0] = vget_low_u8(table);
+	t.val[1] = vget_high_u8(table);
+	return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)), vtbl2_u8(t, vget_high_u8(idx)));
+#endif
+}
+
+// 16 indices to 16 pixels, vst4q interleaves the planes back into pixels
+static INLINE void lookupNEON(unsigned int *out, uint8x16_t idx, const uint8x16_t *planes)
+{
+	uint8x16x4_t pixels;
+
+	pixels.val[0] = tableNEON(planes[0], idx);
+	pixels.val[1] = tableNEON(planes[1], idx);
+	pixels.val[2] = tableNEON(planes[2], idx);
+	pixels.val[3] = tableNEON(planes[3], idx);
+	vst4q_u8((uint8_t *) out, pixels);
+}
+
+static void expandNEON(unsigned int *out, const uint8_t *in, int count, int doubled, const uint8_t table[4][16])
+{
+	uint8x16_t planes[4];
+	uint8x8x2_t idx;
+	uint8x8_t v;
+	int i, k;
+
+	for(k=0; k<4; k++)
+	{
+		planes[k] = vld1q_u8(table[k]);
+	}
+	if(doubled)
+	{
+		for(i=0; i+8<=count; i+=8)
+		{
+			v = vld1_u8(in + i);
+			idx = vzip_u8(v, v);
+			lookupNEON(out + i*2, vcombine_u8(idx.val[0], idx.val[1]), planes);
+		}
+		expandScalar(out + i*2, in + i, count - i, 1, table);
+		return;
+	}
+	for(i=0; i+16<=count; i+=16)
+	{
+		lookupNEON(out + i, vld1q_u8(in + i), planes);
+	}
+	expandScalar(out + i, in + i, count - i, 0, table);
+}
+#endif
+
+static expandFunc expandPixels = expandScalar;
+
+void STICInit(void)
+{
+	int gdata, i;
+
+	for(gdata=0; gdata<256; gdata++)
+	{
+		for(i=0; i<8; i++)
+		{
+			CardMask[gdata][i] = ((gdata>>(7-i))&1) ? 0xFF : 0;
+		}
+		DoubleBits[gdata] = 0;
+		for(i=0; i<8; i++)
+		{
+			DoubleBits[gdata] |= ((gdata>>i)&1) * (3<<(2*i));
+		}
+	}
+
+#if defined(STIC_SIMD_X86)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	{
+		expandPixels = expandAVX2;
+	}
+	else if(__builtin_cpu_supports("ssse3"))
+	{
+		expandPixels = expandSSSE3;
+	}
+#elif defined(STIC_SIMD_NEON)
+	expandPixels = expandNEON;
+#endif
+}
+
+// Draws 8 pixels at x on both lines of scanBuffer, fgcolor where gdata
+// has a bit set and bgcolor elsewhere
+static INLINE void drawStrip(struct STICrender *r, int x, int gdata, uint8_t fgcolor, uint8_t bgcolor)
+{
+	uint64_t mask, strip;
+
+	memcpy(&mask, CardMask[gdata & 0xFF], 8);
+	strip = (bgcolor * PIXELS8) ^ ((fgcolor ^ bgcolor) * PIXELS8 & mask);
+	memcpy(&r->scanBuffer[x], &strip, 8);
+	memcpy(&r->scanBuffer[x+192], &strip, 8);
 }
 
-void drawBackgroundFGBG(int scanline)
+// Draws one line of a card graphic at x, on both lines of scanBuffer
+// and the background collision mask
+static INLINE void drawCardRow(struct STICrender *r, int x, int gdata, uint8_t fgcolor, uint8_t bgcolor)
+{
+	gdata &= 0xFF;
+	drawStrip(r, x, gdata, fgcolor, bgcolor);
+	maskBits(r->collMask[8][0], x, reverse[gdata]);
+}
+
+void drawBackgroundFGBG(const struct STICinput *in, struct STICrender *r, int scanline)
 {
-	int i; 
 	int row, col; // row offset and column of current card
 	int cardrow;  // which of the 8 rows of the current card to draw
 	int card;     // BACKTAB card info
-	unsigned int bgcolor;
-	unsigned int fgcolor;
-	int gaddress; // card graphic address
+	uint8_t bgcolor;
+	uint8_t fgcolor;
+	int gaddress; // card graphic address, from $3000
 	int gdata;    // current card graphic byte
-	int cbit = 1<<8;   // bit 8 - collision bit for Background
-	int x = delayH; // current pixel offset 
+	int x = in->delayH; // current pixel offset 
 
 	// Tiled background is 20x12, cards are 8x8
 	row = scanline / 8; // Which tile row? (Background is 96 lines high)
@@ -244,56 +504,33 @@ void drawBackgroundFGBG(int scanline)
 	// Draw cards
 	for (col=0; col<20; col++) // for each card on the current row...
 	{
-		card = Memory[0x200+row+col]; // card info from BACKTAB
+		card = in->backtab[row+col]; // card info from BACKTAB
 
-		fgcolor = colors[card & 0x07];
-		bgcolor = colors[((card>>9)&0x03) | ((card>>11)&0x04) | ((card>>9)&0x08)]; // bits 12,13,10,9
+		fgcolor = card & 0x07;
+		bgcolor = ((card>>9)&0x03) | ((card>>11)&0x04) | ((card>>9)&0x08); // bits 12,13,10,9
 		
-        gaddress = 0x3000 + (card & 0x09f8);
+        gaddress = card & 0x09f8;
 		
-		gdata = Memory[gaddress + cardrow]; // fetch current line of current card graphic
+		gdata = in->cards[gaddress + cardrow]; // fetch current line of current card graphic
 
-		for(i=7; i>=0; i--) // draw one line of card graphic
-		{
-			if(((gdata>>i)&1)==1)
-			{
-				// draw pixel
-				scanBuffer[x] = fgcolor;
-				scanBuffer[x+1] = fgcolor;
-				scanBuffer[x+384] = fgcolor;
-				scanBuffer[x+384+1] = fgcolor;
-				// write to collision buffer 
-				collBuffer[x] |= cbit;
-				collBuffer[x+384] |= cbit;
-			}
-			else
-			{
-				// draw background
-				scanBuffer[x] = bgcolor;
-				scanBuffer[x+1] = bgcolor;
-				scanBuffer[x+384] = bgcolor;
-				scanBuffer[x+384+1] = bgcolor;
-			}		
-			x+=2;
-		}
+		drawCardRow(r, x, gdata, fgcolor, bgcolor);
+		x+=8;
 	}
 }
 
-void drawBackgroundColorStack(int scanline)
+void drawBackgroundColorStack(const struct STICinput *in, struct STICrender *r, int scanline)
 {
-    int i;
-    unsigned int color1, color2;
-    int cbit1, cbit2;
+    uint8_t color1, color2;
+    int cbits;    // background collision bits of the squares
     int row, col; // row offset and column of current card
     int cardrow;  // which of the 8 rows of the current card to draw
     int card;     // BACKTAB card info
-    unsigned int bgcolor;
-    unsigned int fgcolor;
-    int gaddress; // card graphic address
+    uint8_t bgcolor;
+    uint8_t fgcolor;
+    int gaddress; // card graphic address, from $3000
     int gdata;    // current card graphic byte
     int advcolor; // Flag - Advance CSP
-    int cbit = 1<<8;   // bit 8 - collision bit for Background
-    int x = delayH; // current pixel offset
+    int x = in->delayH; // current pixel offset
     
     // Tiled background is 20x12, cards are 8x8
     row = (scanline / 8); // Which tile row? (Background is 96 lines high)
@@ -301,19 +538,18 @@ void drawBackgroundColorStack(int scanline)
     
     cardrow = scanline % 8; // which line of this row of cards to draw
     
-    if(row==0 && cardrow==0) { CSP = 0x28; } // reset CSP on display of first card on screen
+    if(row==0 && cardrow==0) { r->CSP = 0x28; } // reset CSP on display of first card on screen
     
     // Draw cards
     for (col=0; col<20; col++) // for each card on the current row...
     {
-        card = Memory[0x200+row+col]; // card info from BACKTAB
+        card = in->backtab[row+col]; // card info from BACKTAB
         
         if(((card>>11)&0x03)==2) // Color Squares Mode
         {
             if (cardrow == 0)
-                bgcard[col] = colors[Memory[CSP] & 0x0F];
+                r->bgcard[col] = in->stack[r->CSP-0x28] & 0x0F;
             // set colors
-            colors[7] = bgcard[col]; // color 7 is top of color stack
             color1 = card & 0x07;
             color2 = (card>>3) & 0x07;
             if(cardrow>=4) // switch to lower squares colors
@@ -322,29 +558,15 @@ void drawBackgroundColorStack(int scanline)
                 color2 = ((card>>11)&0x04)|((card>>9)&0x03); // color 4
             }
             // color 7 does not interact with sprites
-            cbit1 = cbit2 = cbit;
-            if(color1==7) { cbit1=0; }
-            if(color2==7) { cbit2=0; }
-            color1 = colors[color1]; // set to rgb24 color
-            color2 = colors[color2];
-            colors[7] = color7; // restore color 7
-            // draw squares
-            for(i=0; i<8; i += 2)
-            {
-                scanBuffer[x] = color1;
-                scanBuffer[x+1] = color1;
-                scanBuffer[x+8] = color2;
-                scanBuffer[x+9] = color2;
-                scanBuffer[x+384] = color1;
-                scanBuffer[x+384+1] = color1;
-                scanBuffer[x+384+8] = color2;
-                scanBuffer[x+384+9] = color2;
-                collBuffer[x] |= cbit1;
-                collBuffer[x+8] |= cbit2;
-                collBuffer[x+384] |= cbit1;
-                collBuffer[x+384+8] |= cbit2;
-                x+=2;
-            }
+            cbits = 0xFF;
+            if(color1==7) { cbits &= 0xF0; }
+            if(color2==7) { cbits &= 0x0F; }
+            // color 7 is top of color stack
+            if(color1==7) { color1 = r->bgcard[col]; }
+            if(color2==7) { color2 = r->bgcard[col]; }
+            // draw squares, color2 is the right half
+            drawStrip(r, x, 0x0F, color2, color1);
+            maskBits(r->collMask[8][0], x, cbits);
             x+=8;
             
         }
@@ -353,53 +575,33 @@ void drawBackgroundColorStack(int scanline)
             if(cardrow == 0) // only advance CSP once per card, cache card colors for later scanlines
             {
                 advcolor = (card>>13) & 0x01; // do we need to advance the CSP?
-                CSP = (CSP+advcolor) & 0x2B; // cycles through 0x28-0x2B
-                fgcard[col] = colors[(card&0x07)|((card>>9)&0x08)]; // bits 12, 2, 1, 0
-                bgcard[col] = colors[Memory[CSP] & 0x0F];
+                r->CSP = (r->CSP+advcolor) & 0x2B; // cycles through 0x28-0x2B
+                r->fgcard[col] = (card&0x07)|((card>>9)&0x08); // bits 12, 2, 1, 0
+                r->bgcard[col] = in->stack[r->CSP-0x28] & 0x0F;
             }
             
-            fgcolor = fgcard[col];
-            bgcolor = bgcard[col];
+            fgcolor = r->fgcard[col];
+            bgcolor = r->bgcard[col];
             
             if (((card >> 11) & 0x01) != 0) /* Card is from GRAM - limit to 64 cards */
-                gaddress = 0x3000 + (card & 0x09f8);
+                gaddress = card & 0x09f8;
             else                             /* Card is from GROM */
-                gaddress = 0x3000 + (card & 0x0ff8);
+                gaddress = card & 0x0ff8;
             
-            gdata = Memory[gaddress + cardrow]; // fetch current line of current card graphic
-            for(i=7; i>=0; i--) // draw one line of card graphic
-            {
-                if(((gdata>>i)&1)==1)
-                {
-                    // draw pixel
-                    scanBuffer[x] = fgcolor;
-                    scanBuffer[x+1] = fgcolor;
-                    scanBuffer[x+384] = fgcolor;
-                    scanBuffer[x+384+1] = fgcolor;
-                    // write to collision buffer 
-                    collBuffer[x] |= cbit;
-                    collBuffer[x+384] |= cbit;
-                }
-                else
-                {
-                    // draw background
-                    scanBuffer[x] = bgcolor;
-                    scanBuffer[x+1] = bgcolor;
-                    scanBuffer[x+384] = bgcolor;
-                    scanBuffer[x+384+1] = bgcolor;
-                }
-                x+=2;
-            }
+            gdata = in->cards[gaddress + cardrow]; // fetch current line of current card graphic
+            drawCardRow(r, x, gdata, fgcolor, bgcolor);
+            x+=8;
         }
     }
 }
 
-void drawSprites(int scanline) // MOBs
+// Returns the interactive MOBs with pixels on this row
+int drawSprites(const struct STICinput *in, struct STICrender *r, int scanline) // MOBs
 {
 	int i, j, k, x;
 	int fgcolor;    // Foreground Color - (Ra bits 12, 2, 1, 0)
 	int Rx, Ry, Ra; // sprite/MOB registers
-	int gaddress;   // address of card / sprite data
+	int gaddress;   // address of card / sprite data, from $3000
 	int gdata;      // current byte of sprite data
 	int gdata2;     // current byte of sprite data (second row for half-height sprites)
 	int card;       // card number - Ra bits 10-3
@@ -411,18 +613,19 @@ void drawSprites(int scanline) // MOBs
 	int posY;       // (Ry bits 6-0)
 	int yRes;       // 0-normal, 1-two tiles high (Ry bit 7)
 	int priority;   // 0-normal, 1-behind background cards (Ra bit 13)
-	int cbit;       // collision bit for collision buffer for collision detection
+	int interactive = 0; // MOBs set in collMask
+	uint64_t bits;  // sprite row in collMask order
 
 	int gfxheight;  // sprite is either 8 or 16 bytes (1 or 2 tiles) tall
 	int spriterow;  // row of sprite data to draw
 
-	if(scanline>104) { return; } // one line extra for bottom border collision
+	if(scanline>104) { return 0; } // one line extra for bottom border collision
 
 	for(i=7; i>=0; i--) // draw sprites 0-7 in reverse order
 	{
-		Rx = Memory[0x00+i]; // 14 bits ; -- -SVI xxxx xxxx ; Size, Visible, Interactive, X Position
-		Ry = Memory[0x08+i]; // 14 bits ; -- YX42 Ryyy yyyy ; Flip Y, Flip X, Size 4, Size 2, Y Resolution, Y Position
-		Ra = Memory[0x10+i]; // 14 bits ; PF Gnnn nnnn nFFF ; Priority, FG Color Bit 3, GRAM, n Card #, FG Color Bits 2-0
+		Rx = in->mob[0x00+i]; // 14 bits ; -- -SVI xxxx xxxx ; Size, Visible, Interactive, X Position
+		Ry = in->mob[0x08+i]; // 14 bits ; -- YX42 Ryyy yyyy ; Flip Y, Flip X, Size 4, Size 2, Y Resolution, Y Position
+		Ra = in->mob[0x10+i]; // 14 bits ; PF Gnnn nnnn nFFF ; Priority, FG Color Bit 3, GRAM, n Card #, FG Color Bits 2-0
 
 		posX  = Rx & 0xFF;
 		posY  = Ry & 0x7F;
@@ -431,8 +634,6 @@ void drawSprites(int scanline) // MOBs
 		// if it's not visible and not interactive, it's disabled
 		if(posX==0 || posX>167 || ((Rx>>8)&0x03)==0 || posY>104) { continue; }
 
-        cbit = 1<<i; // set collision bit
-
         card = Ra & 0x0ff8;
         yRes  = (Ry>>7) & 0x01;
         if(yRes==1)
@@ -442,10 +643,10 @@ void drawSprites(int scanline) // MOBs
         }
 
         // Limit card number to 64 if in GRAM or in Foreground/Background mode
-        if(STICMode==0 || ((Ra>>11) & 0x01) == 1) { card = card & 0x09f8; }
-        gaddress = 0x3000 + card;
+        if(in->mode==0 || ((Ra>>11) & 0x01) == 1) { card = card & 0x09f8; }
+        gaddress = card;
         
-        fgcolor = colors[((Ra>>9)&0x08)|(Ra&0x07)];
+        fgcolor = ((Ra>>9)&0x08)|(Ra&0x07);
         sizeX = (Rx>>10) & 0x01;
         sizeY = (Ry>>8) & 0x03;
         flipX = (Ry>>10) & 0x01;
@@ -474,14 +675,14 @@ void drawSprites(int scanline) // MOBs
 			{
 				spriterow = (7+(8*yRes)) - spriterow;
 				gaddress = gaddress + spriterow; 
-				gdata  = Memory[gaddress] & 0xFF;
-				gdata2 = Memory[gaddress - (sizeY==0)] & 0xFF;
+				gdata  = in->cards[gaddress] & 0xFF;
+				gdata2 = in->cards[gaddress - (sizeY==0)] & 0xFF;
 			}
 			else
 			{
 				gaddress = gaddress + spriterow; 
-				gdata  = Memory[gaddress] & 0xFF;
-				gdata2 = Memory[gaddress + (sizeY==0)] & 0xFF;
+				gdata  = in->cards[gaddress] & 0xFF;
+				gdata2 = in->cards[gaddress + (sizeY==0)] & 0xFF;
 			}
 
 			if(flipX)
@@ -490,26 +691,28 @@ void drawSprites(int scanline) // MOBs
 				gdata2 = reverse[gdata2];
 			}
 
-			// draw sprite row //
-			x = (delayH-16) + (posX * 2); // pixels are 2x2 to accomodate half-height pixels
-
+			// draw sprite row, two lines per row to accomodate half-height pixels //
 			for(j=0; j<2; j++)
 			{
-				for(k=7; k>=0; k--, x+=2+(2*sizeX))
+				x = (in->delayH-8) + posX;
+
+				// set collision mask bits //
+				if(((Rx>>8)&1) && gdata!=0) // if sprite is interactive
+				{
+					bits = reverse[gdata];
+					if(sizeX) { bits = DoubleBits[bits]; } // for double width
+					maskBits(r->collMask[i][j], x, bits);
+					interactive |= 1<<i;
+				}
+
+				for(k=7; k>=0; k--, x+=1+sizeX)
 				{
 					if(((gdata>>k) & 1)==0) // skip ahead if pixel is not visible
 					{
 						continue;
 					} 
 					
-					// set collision and collision buffer bits //
-					if((Rx>>8)&1) // if sprite is interactive
-					{
-						collBuffer[x] |= cbit;
-						collBuffer[x+2*sizeX] |= cbit; // for double width
-					}
-					
-					if(priority && ((collBuffer[x]>>8)&1)) // don't draw if sprite is behind background
+					if(priority && ((r->collMask[8][j][x>>6]>>(x&63))&1)) // don't draw if sprite is behind background
 					{
 						continue;
 					} 
@@ -517,117 +720,426 @@ void drawSprites(int scanline) // MOBs
 					// draw sprite //
 					if((Rx>>9)&1) // if sprite is visible
 					{
-						scanBuffer[x] = fgcolor;
-						scanBuffer[x+1] = fgcolor;
-						scanBuffer[x+2*sizeX] = fgcolor; // for double width
-						scanBuffer[x+3*sizeX] = fgcolor;
+						r->scanBuffer[x + 192*j] = fgcolor;
+						r->scanBuffer[x+sizeX + 192*j] = fgcolor; // for double width
 					}
                 }
 				gdata = gdata2;  // for second half-pixel row  //
-				x = (delayH-16) + 384 + (posX * 2); // for second half-pixel row //
 			}
 		}
 	}
+	return interactive;
 }
 
-void STICDrawFrame(int enabled)
+// Draws one row into scanBuffer and adds its $18-$1F bits to coll
+void drawRow(const struct STICinput *in, struct STICrender *r, int row)
 {
-	int row, offset;
-	int i;
+    int i, j, n, w;
+    int mobs = 0;  // interactive MOBs on this row
+    int bits;      // collision register bits of a MOB
+    uint64_t mob;
 
-    offset = 0;
-    if (enabled == 0) {
-        for (row = 0; row < 112; row++)
+    memset(r->collMask, 0, sizeof(r->collMask));
+    
+    // draw backtab
+    if(row>=in->delayV && row<(96+in->delayV))
+    {
+        if(in->mode==0) // Foreground/Background Mode
         {
-            int color = colors[Memory[0x2C] & 0x0f]; // border color
-            
-            for(i=0; i<352; i++)
-            {
-                scanBuffer[i] = color;
-                scanBuffer[i+384] = color;
+            drawBackgroundFGBG(in, r, row-in->delayV);
+        }
+        else // Color Stack Modes
+        {
+            drawBackgroundColorStack(in, r, row-in->delayV);
+        }
+        memcpy(r->collMask[8][1], r->collMask[8][0], sizeof(r->collMask[8][1]));
+    }
+    
+    if (row>=in->delayV - 1 && row<(97 + in->delayV)) {
+        // draw MOBs
+        mobs = drawSprites(in, r, (row-in->delayV)+8);
+    }
+    
+    // draw border and set final collision bits
+    drawBorder(in, r, row);
+
+    // A MOB latches the bit of every mask it overlaps, its own included
+    for (i = 0; i < 8; i++) {
+        if (((mobs >> i) & 1) == 0)
+            continue;
+        bits = 0;
+        for (j = 0; j < 2; j++) {
+            for (w = 0; w < 3; w++) {
+                mob = r->collMask[i][j][w] & CollColumns[w];
+                if (mob == 0)
+                    continue;
+                for (n = 0; n < 10; n++) {
+                    if (r->collMask[n][j][w] & mob)
+                        bits |= 1 << n;
+                }
             }
-            memcpy(&frame[offset], &scanBuffer[0], 352 * sizeof(unsigned int));
-            memcpy(&frame[offset + 352], &scanBuffer[384], 352 * sizeof(unsigned int));
-            offset += 352 * 2;
         }
+        r->coll[i] |= bits;
+    }
+}
+
+// Copies count words of Memory to the key unless they are there already,
+// returns 1 if they weren't or changed is set
+static int keyRange(unsigned int *key, const unsigned int *mem, int count, int changed)
+{
+    if (changed || memcmp(key, mem, count * sizeof(*key)) != 0) {
+        memcpy(key, mem, count * sizeof(*key));
+        return 1;
+    }
+    return 0;
+}
+
+// Saves what the frame is drawn from in frameInput, returns 0 if it was
+// already there and drawing would give the same frame[] and collisions
+static int frameKeyUpdate(intv_machine *m, int enabled)
+{
+    struct STICinput *in = &m->frameInput;
+    int changed = !m->frameKeyValid || in->mode != m->STICMode || in->enabled != (unsigned int) enabled;
+
+    in->mode = m->STICMode;
+    in->enabled = enabled;
+    changed = keyRange(in->mob, &m->Memory[0x00], 0x18, changed);
+    changed = keyRange(in->stack, &m->Memory[0x28], 0x0B, changed);
+    changed = keyRange(in->backtab, &m->Memory[0x200], 0xF0, changed);
+    changed = keyRange(in->cards, &m->Memory[0x3000], 0xA00, changed);
+    m->frameKeyValid = 1;
+    return changed;
+}
+
+// Latches the collisions of the rows drawn for frameInput
+static void frameCollisions(intv_machine *m)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        if (m->render.coll[i] == 0)
+            continue;
+        MemoryMarkDirty(m, 0x18);
+        m->Memory[0x18 + i] |= m->render.coll[i];
+    }
+}
+
+// Sets the delays of frameInput, and the machine's, from its registers
+void frameDelays(intv_machine *m)
+{
+    struct STICinput *in = &m->frameInput;
+
+    in->extendTop = (in->stack[0x32-0x28]>>1)&0x01;
+    
+    in->extendLeft = (in->stack[0x32-0x28])&0x01;
+    
+    in->delayV = 8 + ((in->stack[0x31-0x28])&0x7);
+    in->delayH = 8 + ((in->stack[0x30-0x28])&0x7);
+
+    m->extendTop = in->extendTop;
+    m->extendLeft = in->extendLeft;
+    m->delayV = in->delayV;
+    m->delayH = in->delayH;
+}
+
+// Draws a 176x224 frame from in, with r as scratch
+static void drawFrame(const struct STICinput *in, struct STICrender *r, uint8_t *frame)
+{
+	int row, offset;
+
+    offset = 0;
+    if (in->enabled == 0) {
+        memset(frame, in->stack[0x2C-0x28] & 0x0f, 176*224); // border color
     } else {
-        extendTop = (Memory[0x32]>>1)&0x01;
-        
-        extendLeft = (Memory[0x32])&0x01;
-        
-        delayV = 8 + ((Memory[0x31])&0x7);
-        delayH = 8 + ((Memory[0x30])&0x7);
-        
-        delayH = delayH * 2;
-        
         for(row=0; row<112; row++)
         {
-            memset(&collBuffer[0], 0, sizeof(collBuffer));
-            
-            // draw backtab
-            if(row>=delayV && row<(96+delayV))
-            {
-                if(STICMode==0) // Foreground/Background Mode
-                {
-                    drawBackgroundFGBG(row-delayV);
-                }
-                else // Color Stack Modes
-                {
-                    drawBackgroundColorStack(row-delayV);
-                }
-            }
-            
-            if (row>=delayV - 1 && row<(97 + delayV)) {
-                // draw MOBs
-                drawSprites((row-delayV)+8);
-            }
-            
-            // draw border and set final collision bits
-            drawBorder(row);
+            drawRow(in, r, row);
+            memcpy(&frame[offset], &r->scanBuffer[0], 176);
+            memcpy(&frame[offset + 176], &r->scanBuffer[192], 176);
+            offset += 176 * 2;
+        }
+    }
+}
 
-            for (i = 1 * 2; i < 168 * 2; i += 2) {
-                if (collBuffer[i] == 0)
-                    continue;
-                if (collBuffer[i] & 0x01)
-                    Memory[0x18] |= collBuffer[i];
-                if (collBuffer[i] & 0x02)
-                    Memory[0x19] |= collBuffer[i];
-                if (collBuffer[i] & 0x04)
-                    Memory[0x1a] |= collBuffer[i];
-                if (collBuffer[i] & 0x08)
-                    Memory[0x1b] |= collBuffer[i];
-                if (collBuffer[i] & 0x10)
-                    Memory[0x1c] |= collBuffer[i];
-                if (collBuffer[i] & 0x20)
-                    Memory[0x1d] |= collBuffer[i];
-                if (collBuffer[i] & 0x40)
-                    Memory[0x1e] |= collBuffer[i];
-                if (collBuffer[i] & 0x80)
-                    Memory[0x1f] |= collBuffer[i];
-            }
-            for (i = 1 * 2 + 384; i < 168 * 2 + 384; i += 2) {
-                if (collBuffer[i] == 0)
-                    continue;
-                if (collBuffer[i] & 0x01)
-                    Memory[0x18] |= collBuffer[i];
-                if (collBuffer[i] & 0x02)
-                    Memory[0x19] |= collBuffer[i];
-                if (collBuffer[i] & 0x04)
-                    Memory[0x1a] |= collBuffer[i];
-                if (collBuffer[i] & 0x08)
-                    Memory[0x1b] |= collBuffer[i];
-                if (collBuffer[i] & 0x10)
-                    Memory[0x1c] |= collBuffer[i];
-                if (collBuffer[i] & 0x20)
-                    Memory[0x1d] |= collBuffer[i];
-                if (collBuffer[i] & 0x40)
-                    Memory[0x1e] |= collBuffer[i];
-                if (collBuffer[i] & 0x80)
-                    Memory[0x1f] |= collBuffer[i];
+void STICDrawFrame(intv_machine *m, int enabled)
+{
+    STICFinishFrame(m);
+    if (!frameKeyUpdate(m, enabled)) {
+        frameCollisions(m); // unchanged frame, frame[] already holds it
+        return;
+    }
+    m->frameVersion++;
+    memset(m->render.coll, 0, sizeof(m->render.coll));
+    if (enabled) {
+        frameDelays(m);
+    }
+    drawFrame(&m->frameInput, &m->render, m->frame);
+    frameCollisions(m);
+}
+
+// frame[] holds colors[] indices at one byte per STIC pixel, the frontend
+// gets them converted and doubled to 352x224 here
+void STICFrameToRGB(intv_machine *m, unsigned int *out)
+{
+	uint8_t planes[4][16];
+
+	colorPlanes(planes);
+	expandPixels(out, m->frame, 176*224, 1, planes);
+}
+
+// The 352x224 frame as presented, in colors[] indices.  Frame hashes are
+// taken over this so they don't depend on the palette or on frame[].
+void STICFrameToIndex(intv_machine *m, uint8_t *out)
+{
+	int i;
+
+	for(i=0; i<176*224; i++)
+	{
+		out[i*2] = out[i*2 + 1] = m->frame[i];
+	}
+}
+
+// Native resolution, one pixel per STIC pixel and 176 wide.  Rows only
+// take two lines when a half-height MOB made their lines differ; returns
+// the height used, 112 or 224.
+int STICFrameToNative(intv_machine *m, unsigned int *out)
+{
+	uint8_t planes[4][16];
+	int row;
+	int tall = 0;
+
+	for(row=0; row<112 && !tall; row++)
+	{
+		tall = memcmp(&m->frame[row*352], &m->frame[row*352 + 176], 176) != 0;
+	}
+	colorPlanes(planes);
+	if(tall)
+	{
+		expandPixels(out, m->frame, 176*224, 0, planes);
+		return 224;
+	}
+	for(row=0; row<112; row++)
+	{
+		expandPixels(&out[row*176], &m->frame[row*352], 176, 0, planes);
+	}
+	return 112;
+}
+
+// Frame skip: collisions only, nothing is drawn into frame[].  Only MOB
+// pixels latch $18-$1F, so rows without an interactive MOB are skipped and
+// the rest go through drawRow for the exact same results.  An unchanged
+// frame latches what it did when drawn.
+// Runs drawRow on the rows with an interactive MOB, after frameDelays
+static void collideRows(const struct STICinput *in, struct STICrender *r)
+{
+    int top[8], bottom[8]; // MOB extents in drawSprites scanlines
+    int Rx, Ry, posX, posY;
+    int i, count, row, scanline;
+
+    count = 0;
+    for (i = 0; i < 8; i++) {
+        Rx = in->mob[0x00+i];
+        Ry = in->mob[0x08+i];
+        posX = Rx & 0xFF;
+        posY = Ry & 0x7F;
+        // same tests as drawSprites, but the MOB must be interactive
+        if (posX==0 || posX>167 || ((Rx>>8)&0x01)==0 || posY>104) { continue; }
+        top[count] = posY;
+        bottom[count] = posY + ((4<<((Ry>>8)&0x03))<<((Ry>>7)&0x01));
+        count++;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    for (row = in->delayV - 1; row < 97 + in->delayV && row < 112; row++)
+    {
+        scanline = (row-in->delayV)+8;
+        for (i = 0; i < count; i++) {
+            if (scanline >= top[i] && scanline < bottom[i]) {
+                drawRow(in, r, row);
+                break;
             }
-            memcpy(&frame[offset], &scanBuffer[0], 352 * sizeof(unsigned int));
-            memcpy(&frame[offset + 352], &scanBuffer[384], 352 * sizeof(unsigned int));
-            offset += 352 * 2;
         }
     }
 }
+
+void STICCollideFrame(intv_machine *m, int enabled)
+{
+    STICFinishFrame(m);
+    if (enabled == 0) {
+        return; // nothing collides with a blank display
+    }
+    if (!frameKeyUpdate(m, enabled)) {
+        frameCollisions(m);
+        return;
+    }
+    m->frameKeyValid = 0; // frame[] was not drawn from the new key
+    frameDelays(m);
+    memset(m->render.coll, 0, sizeof(m->render.coll));
+    collideRows(&m->frameInput, &m->render);
+    frameCollisions(m);
+}
+
+#if defined(HAVE_STIC_THREAD)
+// Render thread.  STICQueueFrame copies the frame inputs to the worker,
+// and the frame is drawn there while the CPU runs on.  Collisions don't
+// wait: they come from collideRows right away, so the CPU sees $18-$1F
+// change exactly when it did before.
+struct STICworker
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int busy;    // a frame is being drawn
+	int quit;
+	int pending; // a frame was queued and not collected yet (CPU thread only)
+	struct STICinput in; // the queued frame
+	struct STICrender r;
+	uint8_t frame[176*224];
+};
+
+static void *workerMain(void *arg)
+{
+	struct STICworker *w = (struct STICworker *) arg;
+
+	pthread_mutex_lock(&w->lock);
+	for(;;)
+	{
+		while(!w->busy && !w->quit)
+		{
+			pthread_cond_wait(&w->cond, &w->lock);
+		}
+		if(w->quit) { break; }
+		pthread_mutex_unlock(&w->lock);
+
+		drawFrame(&w->in, &w->r, w->frame);
+
+		pthread_mutex_lock(&w->lock);
+		w->busy = 0;
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+int STICThreadStart(intv_machine *m)
+{
+	struct STICworker *w;
+
+	if(m->STICWorker != NULL) { return 1; }
+	w = (struct STICworker *) calloc(1, sizeof(struct STICworker));
+	if(w == NULL) { return 0; }
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	if(pthread_create(&w->thread, NULL, workerMain, w) != 0)
+	{
+		pthread_cond_destroy(&w->cond);
+		pthread_mutex_destroy(&w->lock);
+		free(w);
+		return 0;
+	}
+	m->STICWorker = w;
+	return 1;
+}
+
+void STICThreadStop(intv_machine *m)
+{
+	struct STICworker *w = m->STICWorker;
+
+	if(w == NULL) { return; }
+	STICFinishFrame(m);
+	pthread_mutex_lock(&w->lock);
+	w->quit = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+	m->STICWorker = NULL;
+}
+
+void STICFinishFrame(intv_machine *m)
+{
+	struct STICworker *w = m->STICWorker;
+
+	if(w == NULL || !w->pending) { return; }
+	pthread_mutex_lock(&w->lock);
+	while(w->busy)
+	{
+		pthread_cond_wait(&w->cond, &w->lock);
+	}
+	pthread_mutex_unlock(&w->lock);
+	w->pending = 0;
+
+	// the frame and the color stack state drawing leaves behind
+	memcpy(m->frame, w->frame, sizeof(m->frame));
+	m->render.CSP = w->r.CSP;
+	memcpy(m->render.fgcard, w->r.fgcard, sizeof(m->render.fgcard));
+	memcpy(m->render.bgcard, w->r.bgcard, sizeof(m->render.bgcard));
+	m->frameVersion++;
+}
+
+void STICQueueFrame(intv_machine *m, int enabled)
+{
+	struct STICworker *w = m->STICWorker;
+
+	if(w == NULL)
+	{
+		STICDrawFrame(m, enabled);
+		return;
+	}
+	STICFinishFrame(m);
+	if(!frameKeyUpdate(m, enabled))
+	{
+		frameCollisions(m);
+		return;
+	}
+
+	// snapshot: what the frame is drawn from, and the state drawing starts in
+	if(enabled)
+	{
+		frameDelays(m);
+	}
+	memcpy(&w->in, &m->frameInput, sizeof(w->in));
+	w->r.CSP = m->render.CSP;
+	memcpy(w->r.fgcard, m->render.fgcard, sizeof(w->r.fgcard));
+	memcpy(w->r.bgcard, m->render.bgcard, sizeof(w->r.bgcard));
+
+	// $18-$1F now
+	memset(m->render.coll, 0, sizeof(m->render.coll));
+	if(enabled)
+	{
+		collideRows(&m->frameInput, &m->render);
+	}
+	frameCollisions(m);
+
+	w->pending = 1;
+	pthread_mutex_lock(&w->lock);
+	w->busy = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+#else
+int STICThreadStart(intv_machine *m)
+{
+	(void) m;
+	return 0; // built without HAVE_STIC_THREAD
+}
+
+void STICThreadStop(intv_machine *m)
+{
+	(void) m;
+}
+
+void STICFinishFrame(intv_machine *m)
+{
+	(void) m;
+}
+
+void STICQueueFrame(intv_machine *m, int enabled)
+{
+	STICDrawFrame(m, enabled);
+}
+#endif
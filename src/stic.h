@@ -18,19 +18,7 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
-extern unsigned int STICMode; // 0-foreground/background, 1-color stack/color squares 
-
-extern int stic_phase;
-extern int stic_vid_enable;
-extern int stic_reg;
-extern int stic_gram;
-extern int phase_len;
-extern int delayV;
-extern int delayH;
-
-extern int DisplayEnabled; // determines if frame should be updated or not
-
-extern unsigned int frame[352*224]; // frame buffer
+#include "intv.h"
 
 struct STICserialized {
     unsigned int STICMode;
@@ -50,16 +38,28 @@ struct STICserialized {
     int extendLeft;
 
     unsigned int CSP;
-    unsigned int fgcard[20];
-    unsigned int bgcard[20];
-
-    unsigned int frame[352*224];
+    unsigned char fgcard[20];
+    unsigned char bgcard[20];
+    // frame[] isn't saved, it is drawn again from the restored state
 };
 
-void STICSerialize(struct STICserialized *);
-void STICUnserialize(const struct STICserialized *);
+void STICSerialize(intv_machine *m, struct STICserialized *);
+void STICUnserialize(intv_machine *m, const struct STICserialized *);
+
+void STICDrawFrame(intv_machine *m, int);
+void STICCollideFrame(intv_machine *m, int); // collision registers only, frame[] is left as is
+
+// Render thread (builds with HAVE_STIC_THREAD).  Queued frames reach frame[]
+// one frame late, at the next STIC call; collisions are latched at once.
+int STICThreadStart(intv_machine *m); // returns 0 if it can't be started
+void STICThreadStop(intv_machine *m);
+void STICQueueFrame(intv_machine *m, int); // STICDrawFrame without a render thread
+void STICFinishFrame(intv_machine *m); // waits for the queued frame, frame[] then holds it
 
-void STICDrawFrame(int);
-void STICReset(void);
+void STICFrameToRGB(intv_machine *m, unsigned int *out); // 352x224 pixels
+void STICFrameToIndex(intv_machine *m, uint8_t *out); // 352x224 colors[] indices, for hashing
+int STICFrameToNative(intv_machine *m, unsigned int *out); // 176 wide, returns the height
+void STICReset(intv_machine *m);
+void STICInit(void); // shared tables, see IntvInitTables
 
 #endif
@@ -0,0 +1,125 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "intv.h"
+#include "machine.h"
+#include "cp1610.h"
+#include "trace.h"
+
+#ifdef __LIBRETRO__
+#include <streams/file_stream.h>
+#endif
+
+extern const char *Nmemonic[0x400];
+extern int Interuptable[0x400];
+
+int TraceEnabled = 0;
+
+struct trace_record TraceBuffer[TRACE_SIZE];
+
+uint32_t TracePos = 0;    // records written since tracing started
+uint32_t TraceCycles = 0;
+
+void TraceSetEnabled(int enabled)
+{
+	if(enabled && !TraceEnabled)
+	{
+		TracePos = 0;
+		TraceCycles = 0;
+	}
+	TraceEnabled = enabled;
+}
+
+void TraceBegin(intv_machine *m, int instruction)
+{
+	struct trace_record *t = &TraceBuffer[TracePos & (TRACE_SIZE-1)];
+	int i;
+
+	for(i=0; i<8; i++) { t->R[i] = m->R[i]; }
+	t->instruction = instruction;
+	t->flags = (FlagSign(m) ? TRACE_S : 0) |
+		(FlagZero(m) ? TRACE_Z : 0) |
+		(FlagOverflow(m) ? TRACE_O : 0) |
+		(FlagCarry(m) ? TRACE_C : 0) |
+		(m->Flag_InteruptEnable ? TRACE_I : 0) |
+		(m->Flag_DoubleByteData ? TRACE_D : 0) |
+		(Interuptable[instruction & 0x3FF] ? TRACE_i : 0) |
+		(m->SR1 > 0 ? TRACE_q : 0);
+	t->ticks = 0;
+	t->cycle = TraceCycles;
+}
+
+void TraceEnd(int ticks)
+{
+	TraceBuffer[TracePos & (TRACE_SIZE-1)].ticks = ticks;
+	TraceCycles += ticks;
+	TracePos++;
+}
+
+int TraceDump(const char *path)
+{
+	char name[0x400][8];
+	uint32_t head[2];
+	uint32_t first, count, i;
+
+#ifdef __LIBRETRO__
+	RFILE *fp = filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+#else
+	FILE *fp = fopen(path, "wb");
+#endif
+
+	if(fp == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Failed writing trace to: %s\n", path);
+		return 0;
+	}
+
+	count = TracePos < TRACE_SIZE ? TracePos : TRACE_SIZE;
+	first = TracePos - count;
+	head[0] = sizeof(struct trace_record);
+	head[1] = count;
+	memset(name, 0, sizeof(name));
+	for(i=0; i<0x400; i++)
+	{
+		if(Nmemonic[i]) { strncpy(name[i], Nmemonic[i], 7); }
+	}
+
+#ifdef __LIBRETRO__
+	filestream_write(fp, TRACE_MAGIC, 8);
+	filestream_write(fp, head, sizeof(head));
+	filestream_write(fp, name, sizeof(name));
+	for(i=first; i!=TracePos; i++)
+	{
+		filestream_write(fp, &TraceBuffer[i & (TRACE_SIZE-1)], sizeof(struct trace_record));
+	}
+	filestream_close(fp);
+#else
+	fwrite(TRACE_MAGIC, 8, 1, fp);
+	fwrite(head, sizeof(head), 1, fp);
+	fwrite(name, sizeof(name), 1, fp);
+	for(i=first; i!=TracePos; i++)
+	{
+		fwrite(&TraceBuffer[i & (TRACE_SIZE-1)], sizeof(struct trace_record), 1, fp);
+	}
+	fclose(fp);
+#endif
+
+	printf("[INFO] [FREEINTV] Trace of %u instructions written to: %s\n", (unsigned)count, path);
+	return 1;
+}
@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdint.h>
+#include "intv.h"
+
+#define TRACE_SIZE 0x10000 // records kept in the ring, must be a power of two
+
+#define TRACE_MAGIC "FITRACE1"
+
+// Trace record flag bits, in jzIntv column order
+#define TRACE_S 0x80 // Sign
+#define TRACE_Z 0x40 // Zero
+#define TRACE_O 0x20 // Overflow
+#define TRACE_C 0x10 // Carry
+#define TRACE_I 0x08 // Interrupts enabled
+#define TRACE_D 0x04 // SDBD active
+#define TRACE_i 0x02 // Instruction is interruptable
+#define TRACE_q 0x01 // Interrupt requested (SR1)
+
+// One executed instruction, state before it runs
+struct trace_record {
+    uint16_t R[8];        // R0-R7, R7 is the address of the instruction
+    uint16_t instruction;
+    uint8_t flags;        // TRACE_* bits
+    uint8_t ticks;        // cycles used, including a taken interrupt
+    uint32_t cycle;       // total cycles before the instruction
+};
+
+// Trace file (host byte order):
+//   char     magic[8]             TRACE_MAGIC
+//   uint32_t record size
+//   uint32_t record count
+//   char     mnemonic[0x400][8]   Nmemonic[] for the decoder
+//   struct trace_record           oldest first
+
+extern int TraceEnabled;
+
+void TraceSetEnabled(int enabled); // the ring is cleared when tracing starts
+
+void TraceBegin(intv_machine *m, int instruction); // called by CP1610TickDebug before the instruction
+
+void TraceEnd(int ticks); // and after it
+
+int TraceDump(const char *path); // write the ring to a trace file
+
+#endif
@@ -0,0 +1,456 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Batch runner, runs many ROMs headless across all CPU cores
+//   freeintv_batch [-j threads] [-f frames] [-e exec.bin] [-g grom.bin]
+//                  [-o report.txt] [-v] [-d games.dat romdir] [joblist]
+//
+// Each line of the job list is a ROM path, optionally followed by a tab and
+// an input script.  Blank lines and lines starting with # are skipped.
+// With -d the jobs are all roms named in a TOSEC dat (see metadata/), looked
+// up in romdir.  Input scripts hold "frame input0 [input1]" lines, the
+// controller codes (as passed to setControllerInput) apply from that frame.
+//
+// The report has one line per job, in job list order: rom, cart database
+// memory map, frames run, seconds, fps, a hash over all frame hashes and a
+// hash of RAM (scratchpad, system RAM, GRAM) after the last frame.  -v adds
+// the hash of every frame.  Core log messages go to stdout, so use -o to
+// keep the report apart.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+#include "intv.h"
+#include "machine.h"
+#include "stic.h"
+#include "psg.h"
+#include "ivoice.h"
+#include "controller.h"
+
+#define MAX_EVENTS 4096
+
+struct job
+{
+	char rom[1024];
+	char script[1024];
+	int status; // 0 not run, 1 done, 2 halted, 3 missing file
+	int map;
+	int frames; // frames actually run
+	double seconds;
+	uint64_t *frameHash;
+	uint64_t framesHash;
+	uint64_t ramHash;
+};
+
+// Each worker owns a queue of job numbers.  It takes work from the back of
+// its own queue and, once that is empty, steals from the front of the others.
+struct worker
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int *queue;
+	int head;
+	int tail;
+	intv_machine *m;
+};
+
+struct job *Jobs = NULL;
+int JobCount = 0;
+struct worker *Workers = NULL;
+int WorkerCount = 0;
+
+const char *ExecPath = "exec.bin";
+const char *GromPath = "grom.bin";
+int Frames = 3600;
+
+double BatchClock(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+int cpuCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
+
+int fileExists(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL) { return 0; }
+	fclose(fp);
+	return 1;
+}
+
+// FNV-1a over 32 bit words
+uint64_t hashWords(uint64_t hash, const unsigned int *data, int count)
+{
+	int i;
+	for(i=0; i<count; i++)
+	{
+		hash = (hash ^ data[i]) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+// FNV-1a over bytes, for the presented frame (STICFrameToIndex)
+uint64_t hashBytes(uint64_t hash, const uint8_t *data, int count)
+{
+	int i;
+	for(i=0; i<count; i++)
+	{
+		hash = (hash ^ data[i]) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+#define HASH_START 0xCBF29CE484222325ULL
+
+struct job *addJob(const char *rom, const char *script)
+{
+	struct job *job;
+
+	if((JobCount & 255) == 0)
+	{
+		job = (struct job *) realloc(Jobs, (JobCount + 256) * sizeof(struct job));
+		if(job == NULL) { return NULL; }
+		Jobs = job;
+	}
+	job = &Jobs[JobCount++];
+	memset(job, 0, sizeof(struct job));
+	snprintf(job->rom, sizeof(job->rom), "%s", rom);
+	snprintf(job->script, sizeof(job->script), "%s", script);
+	job->map = -1;
+	return job;
+}
+
+void trimLine(char *line)
+{
+	int len = strlen(line);
+	while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' ')) { line[--len] = 0; }
+}
+
+int readJobList(const char *path)
+{
+	char line[2048];
+	char *tab;
+	FILE *fp = fopen(path, "r");
+
+	if(fp == NULL) { return 0; }
+	while(fgets(line, sizeof(line), fp) != NULL)
+	{
+		trimLine(line);
+		if(line[0] == 0 || line[0] == '#') { continue; }
+		tab = strchr(line, '\t');
+		if(tab != NULL) { *tab++ = 0; }
+		addJob(line, tab != NULL ? tab : "");
+	}
+	fclose(fp);
+	return 1;
+}
+
+// Only <rom name="..."> is needed from the dat, so no XML parser
+int readDat(const char *path, const char *romDir)
+{
+	char line[2048];
+	char rom[1024];
+	char *name, *end;
+	FILE *fp = fopen(path, "r");
+
+	if(fp == NULL) { return 0; }
+	while(fgets(line, sizeof(line), fp) != NULL)
+	{
+		name = strstr(line, "<rom name=\"");
+		if(name == NULL) { continue; }
+		name += 11;
+		end = strchr(name, '"');
+		if(end == NULL) { continue; }
+		*end = 0;
+		snprintf(rom, sizeof(rom), "%s/%s", romDir, name);
+		addJob(rom, "");
+	}
+	fclose(fp);
+	return 1;
+}
+
+// returns the number of events, each is frame, input0, input1
+int readScript(const char *path, int events[][3])
+{
+	char line[256];
+	int count = 0;
+	FILE *fp;
+
+	if(path[0] == 0 || (fp = fopen(path, "r")) == NULL) { return 0; }
+	while(count < MAX_EVENTS && fgets(line, sizeof(line), fp) != NULL)
+	{
+		char *p = line;
+		if(line[0] == '#') { continue; }
+		events[count][0] = strtol(p, &p, 0);
+		if(p == line) { continue; }
+		events[count][1] = strtol(p, &p, 0);
+		events[count][2] = strtol(p, &p, 0);
+		count++;
+	}
+	fclose(fp);
+	return count;
+}
+
+void runJob(intv_machine *m, struct job *job)
+{
+	static const int ramRanges[][2] = { {0x0100, 0x035F}, {0x3800, 0x3FFF} };
+	int (*events)[3];
+	uint8_t presented[352*224];
+	int eventCount, next = 0;
+	int input0 = 0, input1 = 0;
+	int f, i;
+	double start;
+
+	if(!fileExists(job->rom))
+	{
+		job->status = 3;
+		return;
+	}
+	job->frameHash = (uint64_t *) malloc(Frames * sizeof(uint64_t));
+	events = malloc(MAX_EVENTS * sizeof(*events));
+	if(job->frameHash == NULL || events == NULL)
+	{
+		free(events);
+		job->status = 3;
+		return;
+	}
+	eventCount = readScript(job->script, events);
+
+	start = BatchClock();
+	IntvPowerCycle(m);
+	loadExec(m, ExecPath);
+	loadGrom(m, GromPath);
+	LoadGame(m, job->rom);
+	job->map = m->cart_map;
+
+	job->status = 1;
+	job->framesHash = HASH_START;
+	for(f=0; f<Frames; f++)
+	{
+		while(next < eventCount && events[next][0] <= f)
+		{
+			input0 = events[next][1];
+			input1 = events[next][2];
+			next++;
+		}
+		setControllerInput(m, 0, input0);
+		setControllerInput(m, 1, input1);
+		Run(m);
+		PSGFrame(m);
+		ivoice_frame(m);
+
+		STICFrameToIndex(m, presented);
+		job->frameHash[f] = hashBytes(HASH_START, presented, sizeof(presented));
+		job->framesHash = (job->framesHash ^ job->frameHash[f]) * 0x100000001B3ULL;
+		job->frames = f + 1;
+		if(m->intv_halt)
+		{
+			job->status = 2;
+			break;
+		}
+	}
+	job->ramHash = HASH_START;
+	for(i=0; i<2; i++)
+	{
+		job->ramHash = hashWords(job->ramHash, &m->Memory[ramRanges[i][0]], ramRanges[i][1] - ramRanges[i][0] + 1);
+	}
+	job->seconds = BatchClock() - start;
+	free(events);
+}
+
+int takeJob(struct worker *w, int own)
+{
+	int n = -1;
+
+	pthread_mutex_lock(&w->lock);
+	if(w->head < w->tail)
+	{
+		n = own ? w->queue[--w->tail] : w->queue[w->head++];
+	}
+	pthread_mutex_unlock(&w->lock);
+	return n;
+}
+
+void *workerMain(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	int self = w - Workers;
+	int i, n;
+
+	for(;;)
+	{
+		n = takeJob(w, 1);
+		for(i=1; n < 0 && i < WorkerCount; i++)
+		{
+			n = takeJob(&Workers[(self + i) % WorkerCount], 0);
+		}
+		if(n < 0) { break; } // no work left anywhere, jobs are never added while running
+		runJob(w->m, &Jobs[n]);
+	}
+	return NULL;
+}
+
+void writeReport(FILE *out, int verbose, double total)
+{
+	static const char *status[] = { "skipped", "ok", "halted", "missing" };
+	int i, f;
+
+	fprintf(out, "# rom\tmap\tframes\tseconds\tfps\tframes_hash\tram_hash\tstatus\n");
+	for(i=0; i<JobCount; i++)
+	{
+		struct job *job = &Jobs[i];
+		fprintf(out, "%s\t%d\t%d\t%.3f\t%.1f\t%016llx\t%016llx\t%s\n", job->rom, job->map, job->frames,
+			job->seconds, job->seconds > 0 ? job->frames / job->seconds : 0.0,
+			(unsigned long long)job->framesHash, (unsigned long long)job->ramHash, status[job->status]);
+		for(f=0; verbose && f<job->frames; f++)
+		{
+			fprintf(out, "\t%d\t%016llx\n", f, (unsigned long long)job->frameHash[f]);
+		}
+	}
+	fprintf(out, "# %d jobs on %d threads in %.3f s\n", JobCount, WorkerCount, total);
+}
+
+int main(int argc, char **argv)
+{
+	const char *reportPath = NULL;
+	int verbose = 0;
+	int i, j;
+	double start;
+	FILE *out = stdout;
+
+	WorkerCount = cpuCount();
+	for(i=1; i<argc; i++)
+	{
+		if(strcmp(argv[i], "-j") == 0 && i+1<argc) { WorkerCount = atoi(argv[++i]); }
+		else if(strcmp(argv[i], "-f") == 0 && i+1<argc) { Frames = atoi(argv[++i]); }
+		else if(strcmp(argv[i], "-e") == 0 && i+1<argc) { ExecPath = argv[++i]; }
+		else if(strcmp(argv[i], "-g") == 0 && i+1<argc) { GromPath = argv[++i]; }
+		else if(strcmp(argv[i], "-o") == 0 && i+1<argc) { reportPath = argv[++i]; }
+		else if(strcmp(argv[i], "-v") == 0) { verbose = 1; }
+		else if(strcmp(argv[i], "-d") == 0 && i+2<argc)
+		{
+			if(!readDat(argv[i+1], argv[i+2]))
+			{
+				printf("[ERROR] [FREEINTV] Can't read %s\n", argv[i+1]);
+				return 1;
+			}
+			i += 2;
+		}
+		else if(argv[i][0] == '-')
+		{
+			printf("usage: %s [-j threads] [-f frames] [-e exec.bin] [-g grom.bin] [-o report.txt] [-v] [-d games.dat romdir] [joblist]\n", argv[0]);
+			return 1;
+		}
+		else if(!readJobList(argv[i]))
+		{
+			printf("[ERROR] [FREEINTV] Can't read %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if(JobCount == 0 || Frames < 1 || !fileExists(ExecPath) || !fileExists(GromPath))
+	{
+		printf("[ERROR] [FREEINTV] Need jobs, %s and %s\n", ExecPath, GromPath);
+		return 1;
+	}
+	if(WorkerCount < 1) { WorkerCount = 1; }
+	if(WorkerCount > JobCount) { WorkerCount = JobCount; }
+
+	// Shared tables and machines are set up here, before any worker runs
+	IntvInitTables();
+	Workers = (struct worker *) calloc(WorkerCount, sizeof(struct worker));
+	for(i=0; Workers != NULL && i<WorkerCount; i++)
+	{
+		Workers[i].m = IntvCreate();
+		Workers[i].queue = (int *) malloc(JobCount * sizeof(int));
+		if(Workers[i].m == NULL || Workers[i].queue == NULL)
+		{
+			printf("[ERROR] [FREEINTV] Out of memory\n");
+			return 1;
+		}
+		pthread_mutex_init(&Workers[i].lock, NULL);
+		// deal jobs out in reverse, so each worker runs its share in list order
+		for(j=JobCount-1-i; j>=0; j-=WorkerCount)
+		{
+			Workers[i].queue[Workers[i].tail++] = j;
+		}
+	}
+	if(Workers == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Out of memory\n");
+		return 1;
+	}
+
+	start = BatchClock();
+	for(i=0; i<WorkerCount; i++)
+	{
+		pthread_create(&Workers[i].thread, NULL, workerMain, &Workers[i]);
+	}
+	for(i=0; i<WorkerCount; i++)
+	{
+		pthread_join(Workers[i].thread, NULL);
+	}
+
+	if(reportPath != NULL && (out = fopen(reportPath, "w")) == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Can't write %s\n", reportPath);
+		out = stdout;
+	}
+	writeReport(out, verbose, BatchClock() - start);
+	if(out != stdout) { fclose(out); }
+
+	for(i=0; i<WorkerCount; i++)
+	{
+		IntvDestroy(Workers[i].m);
+		free(Workers[i].queue);
+		pthread_mutex_destroy(&Workers[i].lock);
+	}
+	for(i=0; i<JobCount; i++)
+	{
+		free(Jobs[i].frameHash);
+	}
+	free(Workers);
+	free(Jobs);
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Headless benchmark, runs the core without a libretro frontend
+//   freeintv_bench [-f frames] [-t] [-c mode] [-i] [-e exec.bin] [-g grom.bin] [rom]
+// The defaults are 3600 frames of open-content/4-Tris with exec.bin and
+// grom.bin from the current directory.  -t draws frames on the render
+// thread, STIC time is then only what the CPU thread spends on it; it
+// needs a build with HAVE_STIC_THREAD (the default where the core has it).
+// -c picks the CPU mode of CP1610SetCache: 0 interpreter, 1 decode cache,
+// 1 decode cache (the default), 2 compiled blocks (same as 1 without the
+// x86-64 compiler).
+// -i compares the modes instead: it counts the instructions of the run
+// once with the profiler, then runs it in each mode and reports
+// instructions per second of CPU+memory time.  The input is the same
+// every run, so all modes execute the same instructions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "intv.h"
+#include "machine.h"
+#include "memory.h"
+#include "cp1610.h"
+#include "stic.h"
+#include "psg.h"
+#include "ivoice.h"
+#include "controller.h"
+#include "profile.h"
+#include "bench.h"
+
+#define CYCLES_PER_FRAME 14934 // sum of the STIC phase lengths in exec()
+#define NTSC_FPS 59.92
+
+double BenchTime[BENCH_TIMERS];
+
+double BenchClock(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+int fileExists(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL) { return 0; }
+	fclose(fp);
+	return 1;
+}
+
+// power cycle and load everything, returns 0 when the render thread can't start
+int loadMachine(intv_machine *m, const char *execPath, const char *gromPath, const char *romPath, int cpuMode, int threaded)
+{
+	IntvPowerCycle(m);
+	CP1610SetCache(m, cpuMode);
+	loadExec(m, execPath);
+	loadGrom(m, gromPath);
+	LoadGame(m, romPath);
+	return !threaded || STICThreadStart(m);
+}
+
+// runs the frames with pseudo-random input, returns the seconds taken
+double runFrames(intv_machine *m, int frames)
+{
+	// Disc directions and action buttons, so games get past their title screens
+	int codes[] = { 0x00, 0x04, 0x01, 0x08, 0x02, 0xA0, 0x60, 0xC0, 0x00, 0x00 };
+	unsigned int seed = 1;
+	int input = 0;
+	int f;
+	double start, total;
+
+	memset(BenchTime, 0, sizeof(BenchTime));
+	start = BenchClock();
+	for(f=0; f<frames; f++)
+	{
+		if(f % 30 == 0)
+		{
+			seed = seed * 1103515245 + 12345;
+			input = codes[(seed >> 16) % (sizeof(codes) / sizeof(codes[0]))];
+		}
+		setControllerInput(m, 0, input);
+		Run(m);
+		PSGFrame(m);
+		ivoice_frame(m);
+	}
+	total = BenchClock() - start;
+	return total > 0 ? total : 1e-9;
+}
+
+double cpuTime(double total) // total without STIC, PSG and Intellivoice
+{
+	return total - BenchTime[BENCH_STIC] - BenchTime[BENCH_PSG] - BenchTime[BENCH_IVOICE];
+}
+
+int main(int argc, char **argv)
+{
+	const char *execPath = "exec.bin";
+	const char *gromPath = "grom.bin";
+	const char *romPath = "open-content/4-Tris/4-tris.bin";
+	int frames = 3600;
+	int i;
+	int threaded = 0;
+	int cpuMode = 1;
+	int compare = 0;
+	intv_machine *m;
+	double total, cpu, base = 0;
+	uint64_t instructions;
+	const char *modeNames[] = { "interpreter", "decode cache", "compiled blocks" };
+
+	for(i=1; i<argc; i++)
+	{
+		if(strcmp(argv[i], "-f") == 0 && i+1<argc) { frames = atoi(argv[++i]); }
+		else if(strcmp(argv[i], "-t") == 0) { threaded = 1; }
+		else if(strcmp(argv[i], "-c") == 0 && i+1<argc) { cpuMode = atoi(argv[++i]); }
+		else if(strcmp(argv[i], "-i") == 0) { compare = 1; }
+		else if(strcmp(argv[i], "-e") == 0 && i+1<argc) { execPath = argv[++i]; }
+		else if(strcmp(argv[i], "-g") == 0 && i+1<argc) { gromPath = argv[++i]; }
+		else if(argv[i][0] == '-')
+		{
+			printf("usage: %s [-f frames] [-t] [-c mode] [-i] [-e exec.bin] [-g grom.bin] [rom]\n", argv[0]);
+			return 1;
+		}
+		else { romPath = argv[i]; }
+	}
+	if(!fileExists(execPath) || !fileExists(gromPath) || !fileExists(romPath))
+	{
+		printf("[ERROR] [FREEINTV] Need %s, %s and %s\n", execPath, gromPath, romPath);
+		return 1;
+	}
+
+	IntvInitTables();
+	m = IntvCreate();
+	if(m == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Out of memory\n");
+		return 1;
+	}
+	if(!loadMachine(m, execPath, gromPath, romPath, cpuMode, threaded))
+	{
+		printf("[ERROR] [FREEINTV] No render thread, built without HAVE_STIC_THREAD\n");
+		return 1;
+	}
+
+	if(compare)
+	{
+		ProfileSetEnabled(1);
+		runFrames(m, frames);
+		ProfileSetEnabled(0);
+		instructions = ProfileInstructions();
+
+		printf("%s: %d frames, %llu instructions\n", romPath, frames, (unsigned long long)instructions);
+		for(i=0; i<3; i++)
+		{
+			loadMachine(m, execPath, gromPath, romPath, i, threaded);
+			cpu = cpuTime(runFrames(m, frames));
+			if(i == 0) { base = cpu; }
+			printf("  %d %-16s %7.3f s %8.2f M instructions/s %5.2fx\n", i, modeNames[i], cpu,
+				instructions / cpu / 1e6, base / cpu);
+		}
+		IntvDestroy(m);
+		return 0;
+	}
+
+	total = runFrames(m, frames);
+	cpu = cpuTime(total);
+
+	printf("%s: %d frames in %.3f s%s\n", romPath, frames, total, m->intv_halt ? " (CPU halted)" : "");
+	printf("  %.1f fps, %.1fx real time\n", frames / total, frames / total / NTSC_FPS);
+	printf("  emulated CPU %.2f MHz\n", (double)frames * CYCLES_PER_FRAME / total / 1e6);
+	printf("  %-12s %7.3f s %5.1f%%\n", "CPU+memory", cpu, 100.0 * cpu / total);
+	printf("  %-12s %7.3f s %5.1f%%\n", "STIC", BenchTime[BENCH_STIC], 100.0 * BenchTime[BENCH_STIC] / total);
+	printf("  %-12s %7.3f s %5.1f%%\n", "PSG", BenchTime[BENCH_PSG], 100.0 * BenchTime[BENCH_PSG] / total);
+	printf("  %-12s %7.3f s %5.1f%%\n", "Intellivoice", BenchTime[BENCH_IVOICE], 100.0 * BenchTime[BENCH_IVOICE] / total);
+
+	IntvDestroy(m);
+	return 0;
+}
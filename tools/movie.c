@@ -0,0 +1,221 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Input movie player, replays a movie headless as fast as possible
+//   freeintv_movie [-e exec.bin] [-g grom.bin] rom movie.fimv
+//   freeintv_movie -r [-f frames] [-i interval] [-s script] [-e exec.bin] [-g grom.bin] rom movie.fimv
+//
+// Playback compares the machine hashes in the movie and reports the first
+// one that differs, so a change to the core can be checked against movies
+// recorded before it (with the freeintv_movie core option, or with -r).
+// The first divergent frame lies between the last matching hash and that
+// one; record with -i 1 to hash every frame and pin it down exactly.
+// Exits with 0 when the whole movie matched, 1 on divergence, 2 on errors.
+//
+// -r records a movie instead, from an input script of "frame input0 [input1]"
+// lines (controller codes as passed to setControllerInput, see
+// freeintv_batch) or with no input at all.  -i sets the frames between
+// hashes (default MOVIE_HASH_INTERVAL).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "intv.h"
+#include "machine.h"
+#include "psg.h"
+#include "ivoice.h"
+#include "controller.h"
+#include "movie.h"
+
+double MovieClock(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+int fileExists(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL) { return 0; }
+	fclose(fp);
+	return 1;
+}
+
+int record(intv_machine *m, const char *moviePath, const char *scriptPath, int frames, int interval)
+{
+	char line[256];
+	int input0 = 0, input1 = 0;
+	int event = -1, event0 = 0, event1 = 0;
+	int f;
+	FILE *script = NULL;
+	intv_movie *mv;
+
+	if(scriptPath != NULL && (script = fopen(scriptPath, "r")) == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Can't read %s\n", scriptPath);
+		return 2;
+	}
+	mv = MovieCreate(m, interval);
+	if(mv == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Out of memory\n");
+		if(script != NULL) { fclose(script); }
+		return 2;
+	}
+	for(f=0; f<frames; f++)
+	{
+		// events are in frame order, the next one is read ahead
+		for(;;)
+		{
+			if(event < 0 && script != NULL && fgets(line, sizeof(line), script) != NULL)
+			{
+				char *p = line;
+				if(line[0] == '#') { continue; }
+				event = strtol(p, &p, 0);
+				if(p == line) { event = -1; continue; }
+				event0 = strtol(p, &p, 0);
+				event1 = strtol(p, &p, 0);
+			}
+			if(event < 0 || event > f) { break; }
+			input0 = event0;
+			input1 = event1;
+			event = -1;
+		}
+		setControllerInput(m, 0, input0);
+		setControllerInput(m, 1, input1);
+		MovieInput(mv, m);
+		Run(m);
+		MovieCheck(mv, m);
+		PSGFrame(m);
+		ivoice_frame(m);
+	}
+	if(script != NULL) { fclose(script); }
+	if(!MovieSave(mv, moviePath))
+	{
+		MovieDestroy(mv);
+		return 2;
+	}
+	printf("%s: recorded %d frames\n", moviePath, MovieFrames(mv));
+	MovieDestroy(mv);
+	return 0;
+}
+
+int play(intv_machine *m, const char *moviePath)
+{
+	intv_movie *mv = MovieLoad(moviePath);
+	int f, matched = -1, result = 0, check;
+	double start, total;
+
+	if(mv == NULL)
+	{
+		printf("[ERROR] [FREEINTV] %s is not a movie\n", moviePath);
+		return 2;
+	}
+	if(!MovieMatchesCart(mv, m))
+	{
+		printf("[ERROR] [FREEINTV] %s was recorded with another cart\n", moviePath);
+		MovieDestroy(mv);
+		return 2;
+	}
+	start = MovieClock();
+	for(f=0; MovieInput(mv, m); f++)
+	{
+		Run(m);
+		check = MovieCheck(mv, m);
+		if(check == 2) { matched = f; }
+		if(check == 0)
+		{
+			printf("%s: diverged in frames %d-%d (hash after frame %d differs)\n", moviePath, matched + 1, f, f);
+			result = 1;
+			break;
+		}
+		PSGFrame(m);
+		ivoice_frame(m);
+	}
+	total = MovieClock() - start;
+	if(total <= 0) { total = 1e-9; }
+	if(result == 0)
+	{
+		printf("%s: all %d frames match (%.1f fps)\n", moviePath, f, f / total);
+	}
+	MovieDestroy(mv);
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	const char *execPath = "exec.bin";
+	const char *gromPath = "grom.bin";
+	const char *scriptPath = NULL;
+	const char *paths[2] = { NULL, NULL };
+	int recording = 0;
+	int frames = 3600;
+	int interval = MOVIE_HASH_INTERVAL;
+	int i, n = 0, result;
+	intv_machine *m;
+
+	for(i=1; i<argc; i++)
+	{
+		if(strcmp(argv[i], "-r") == 0) { recording = 1; }
+		else if(strcmp(argv[i], "-f") == 0 && i+1<argc) { frames = atoi(argv[++i]); }
+		else if(strcmp(argv[i], "-i") == 0 && i+1<argc) { interval = atoi(argv[++i]); }
+		else if(strcmp(argv[i], "-s") == 0 && i+1<argc) { scriptPath = argv[++i]; }
+		else if(strcmp(argv[i], "-e") == 0 && i+1<argc) { execPath = argv[++i]; }
+		else if(strcmp(argv[i], "-g") == 0 && i+1<argc) { gromPath = argv[++i]; }
+		else if(argv[i][0] != '-' && n < 2) { paths[n++] = argv[i]; }
+		else { n = 3; break; }
+	}
+	if(n != 2)
+	{
+		printf("usage: %s [-r [-f frames] [-i interval] [-s script]] [-e exec.bin] [-g grom.bin] rom movie.fimv\n", argv[0]);
+		return 2;
+	}
+	if(!fileExists(execPath) || !fileExists(gromPath) || !fileExists(paths[0]))
+	{
+		printf("[ERROR] [FREEINTV] Need %s, %s and %s\n", execPath, gromPath, paths[0]);
+		return 2;
+	}
+
+	IntvInitTables();
+	m = IntvCreate();
+	if(m == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Out of memory\n");
+		return 2;
+	}
+	loadExec(m, execPath);
+	loadGrom(m, gromPath);
+	LoadGame(m, paths[0]);
+
+	result = recording ? record(m, paths[1], scriptPath, frames, interval) : play(m, paths[1]);
+	IntvDestroy(m);
+	return result;
+}
@@ -0,0 +1,389 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Golden frame-hash regression suite
+//   freeintv_regress [-u] [-v] [caselist]
+//
+// Runs every case of the list (default tests/regress.txt) and compares the
+// hash of each frame and of each frame's audio (PSGBuffer and
+// ivoiceBuffer) with the golden file of the case.  Any change to the STIC,
+// PSG, Intellivoice or CPU emulation that alters output shows up as the
+// first frame whose hash differs.  -u writes the golden files from the
+// current build instead, -v lists every differing frame.  `make test` runs
+// the suite; the exit status is 0 when all cases match.
+//
+// Each line of the case list is "rom frames script golden", paths relative
+// to the current directory, script "-" for no input.  Scripts hold
+// "frame input0 [input1]" lines as for freeintv_batch.
+//
+// Frames are hashed as presented, 352x224 RGB (see hashFrame), so the
+// golden files don't depend on how the renderer stores frame[].
+//
+// The cases run on a small stand-in for the EXEC and GROM (see BootExec)
+// rather than the real BIOS, so the golden files are the same for
+// everybody and need no copyrighted images.
+//
+// Before the list, checkDirtyPages runs stores through writeMem and checks
+// the pages MemoryDirtyPages reports.  It counts as one more case.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "intv.h"
+#include "machine.h"
+#include "memory.h"
+#include "stic.h"
+#include "psg.h"
+#include "ivoice.h"
+#include "controller.h"
+
+#define HASH_START 0xCBF29CE484222325ULL
+
+// EXEC stand-in.  Boots the cart through the start address in its header
+// at $5004/$5005, like the EXEC, and dispatches interrupts through the
+// vector games keep at $100/$101.
+static const unsigned int BootExec[] =
+{
+	// $1000: J $1020
+	0x0004, 0x0310, 0x0020,
+	0x0000,
+	// $1004: interrupt, save registers, call [$100/$101] returning to $1013
+	0x0270, 0x0271, 0x0272, 0x0273, 0x0274, 0x0275, // PSHR R0-R5
+	0x0280, 0x0100, // MVI $100, R0
+	0x0281, 0x0101, // MVI $101, R1
+	0x0041,         // SWAP R1
+	0x00C8,         // ADDR R1, R0
+	0x02BD, 0x1013, // MVII #$1013, R5
+	0x0087,         // JR R0
+	// $1013: restore registers and return
+	0x02B5, 0x02B4, 0x02B3, 0x02B2, 0x02B1, 0x02B0, // PULR R5-R0
+	0x02B7          // PULR R7
+};
+
+static const unsigned int BootStart[] =
+{
+	// $1020: jump to the cart's start address
+	0x0280, 0x5004, // MVI $5004, R0
+	0x0281, 0x5005, // MVI $5005, R1
+	0x0041,         // SWAP R1
+	0x00C8,         // ADDR R1, R0
+	0x0087          // JR R0
+};
+
+void loadStandInBios(intv_machine *m)
+{
+	unsigned int seed = 12345;
+	int i;
+
+	for(i=0x1000; i<=0x1FFF; i++) { m->Memory[i] = 0; }
+	memcpy(&m->Memory[0x1000], BootExec, sizeof(BootExec));
+	memcpy(&m->Memory[0x1020], BootStart, sizeof(BootStart));
+
+	// GROM cards get a fixed pseudo-random pattern, so they show up in frames
+	for(i=0x3000; i<=0x37FF; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		m->Memory[i] = (seed >> 16) & 0xFF;
+	}
+	MemoryMarkAllDirty(m);
+}
+
+uint64_t hashWords(uint64_t hash, const unsigned int *data, int count)
+{
+	int i;
+	for(i=0; i<count; i++)
+	{
+		hash = (hash ^ (data[i] & 0xFFFFFF)) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+// the frame as a frontend gets it
+uint64_t hashFrame(intv_machine *m)
+{
+	static unsigned int presented[352*224];
+
+	STICFrameToRGB(m, presented);
+	return hashWords(HASH_START, presented, 352*224);
+}
+
+uint64_t hashSamples(uint64_t hash, const int16_t *data, int count)
+{
+	int i;
+	for(i=0; i<count; i++)
+	{
+		hash = (hash ^ (uint16_t) data[i]) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+// returns the number of events, each is frame, input0, input1
+int readScript(const char *path, int (**events)[3])
+{
+	char line[256];
+	int count = 0, size = 0;
+	FILE *fp;
+
+	*events = NULL;
+	if(strcmp(path, "-") == 0) { return 0; }
+	if((fp = fopen(path, "r")) == NULL) { return -1; }
+	while(fgets(line, sizeof(line), fp) != NULL)
+	{
+		char *p = line;
+		if(line[0] == '#') { continue; }
+		if(count == size)
+		{
+			size = size ? size * 2 : 256;
+			*events = realloc(*events, size * sizeof(**events));
+			if(*events == NULL) { fclose(fp); return -1; }
+		}
+		(*events)[count][0] = strtol(p, &p, 0);
+		if(p == line) { continue; }
+		(*events)[count][1] = strtol(p, &p, 0);
+		(*events)[count][2] = strtol(p, &p, 0);
+		count++;
+	}
+	fclose(fp);
+	return count;
+}
+
+// hashes[] holds a video and an audio hash per frame
+int readGolden(const char *path, uint64_t *hashes, int frames)
+{
+	char line[256];
+	unsigned long long video, audio;
+	int f, count = 0;
+	FILE *fp = fopen(path, "r");
+
+	if(fp == NULL) { return -1; }
+	while(fgets(line, sizeof(line), fp) != NULL)
+	{
+		if(line[0] == '#') { continue; }
+		if(sscanf(line, "%d %llx %llx", &f, &video, &audio) != 3 || f != count || f >= frames) { break; }
+		hashes[f*2] = video;
+		hashes[f*2+1] = audio;
+		count++;
+	}
+	fclose(fp);
+	return count;
+}
+
+int writeGolden(const char *path, const char *rom, const char *script, const uint64_t *hashes, int frames)
+{
+	int f;
+	FILE *fp = fopen(path, "w");
+
+	if(fp == NULL) { return 0; }
+	fprintf(fp, "# %s, input %s\n", rom, script);
+	fprintf(fp, "# frame video_hash audio_hash\n");
+	for(f=0; f<frames; f++)
+	{
+		fprintf(fp, "%d %016llx %016llx\n", f, (unsigned long long) hashes[f*2], (unsigned long long) hashes[f*2+1]);
+	}
+	fclose(fp);
+	return 1;
+}
+
+// Stores to $0200, $02F0, $035A and the protected EXEC ROM must report
+// pages $02 and $03, a PSG register store (writeScratch and PSGNotify)
+// page $01, and each MemoryDirtyPages call must leave the bitmap clear.
+// returns 1 when all of them do
+int checkDirtyPages(intv_machine *m)
+{
+	static const int writes[3][4] = { { 0x0200, 0x02F0, 0x035A, 0x1000 }, { 0x01F1 }, { 0 } };
+	static const int writeCount[3] = { 4, 1, 0 };
+	static const unsigned char expected[3][2] = { { 0x02, 0x03 }, { 0x01 }, { 0 } };
+	static const int expectedCount[3] = { 2, 1, 0 };
+	unsigned char pages[256];
+	int step, i, count, ok = 1;
+
+	IntvPowerCycle(m);
+	loadStandInBios(m);
+	if(MemoryDirtyPages(m, pages) != 256)
+	{
+		printf("FAIL MemoryDirtyPages: MemoryMarkAllDirty didn't mark all 256 pages\n");
+		ok = 0;
+	}
+	for(step=0; step<3; step++)
+	{
+		for(i=0; i<writeCount[step]; i++)
+		{
+			writeMem(m, writes[step][i], 0x55);
+		}
+		count = MemoryDirtyPages(m, pages);
+		if(count != expectedCount[step] || memcmp(pages, expected[step], count) != 0)
+		{
+			printf("FAIL MemoryDirtyPages: step %d listed %d pages, expected %d\n", step, count, expectedCount[step]);
+			ok = 0;
+		}
+		for(i=0; i<8; i++)
+		{
+			if(m->DirtyPages[i] != 0)
+			{
+				printf("FAIL MemoryDirtyPages: step %d left the bitmap set\n", step);
+				ok = 0;
+				break;
+			}
+		}
+	}
+	if(ok)
+	{
+		printf("PASS MemoryDirtyPages\n");
+	}
+	return ok;
+}
+
+// returns 1 when the case matches (or was updated)
+int runCase(intv_machine *m, const char *rom, int frames, const char *script, const char *golden, int update, int verbose)
+{
+	int (*events)[3];
+	uint64_t *hashes, *expected;
+	int eventCount, goldenFrames = 0, next = 0;
+	int input0 = 0, input1 = 0;
+	int f, firstVideo = -1, firstAudio = -1, differ = 0, ok;
+
+	eventCount = readScript(script, &events);
+	hashes = (uint64_t *) malloc(frames * 2 * sizeof(uint64_t));
+	expected = (uint64_t *) malloc(frames * 2 * sizeof(uint64_t));
+	if(eventCount < 0 || hashes == NULL || expected == NULL)
+	{
+		printf("FAIL %s: can't read %s\n", golden, script);
+		free(events);
+		free(hashes);
+		free(expected);
+		return 0;
+	}
+	if(!update)
+	{
+		goldenFrames = readGolden(golden, expected, frames);
+	}
+
+	IntvPowerCycle(m);
+	loadStandInBios(m);
+	LoadGame(m, rom);
+	for(f=0; f<frames; f++)
+	{
+		while(next < eventCount && events[next][0] <= f)
+		{
+			input0 = events[next][1];
+			input1 = events[next][2];
+			next++;
+		}
+		setControllerInput(m, 0, input0);
+		setControllerInput(m, 1, input1);
+		Run(m);
+
+		hashes[f*2] = hashFrame(m);
+		hashes[f*2+1] = hashSamples(hashSamples(HASH_START, m->PSGBuffer, m->PSGBufferPos),
+			m->ivoiceBuffer, AUDIO_FREQUENCY / 60);
+		PSGFrame(m);
+		ivoice_frame(m);
+
+		if(f < goldenFrames && (hashes[f*2] != expected[f*2] || hashes[f*2+1] != expected[f*2+1]))
+		{
+			if(hashes[f*2] != expected[f*2] && firstVideo < 0) { firstVideo = f; }
+			if(hashes[f*2+1] != expected[f*2+1] && firstAudio < 0) { firstAudio = f; }
+			if(verbose)
+			{
+				printf("  frame %d:%s%s\n", f, hashes[f*2] != expected[f*2] ? " video" : "",
+					hashes[f*2+1] != expected[f*2+1] ? " audio" : "");
+			}
+			differ++;
+		}
+	}
+
+	if(update)
+	{
+		ok = writeGolden(golden, rom, script, hashes, frames);
+		printf("%s %s: %d frames\n", ok ? "WROTE" : "FAIL", golden, frames);
+	}
+	else if(goldenFrames < 0)
+	{
+		ok = 0;
+		printf("FAIL %s: no golden file, run with -u to create it\n", golden);
+	}
+	else if(goldenFrames < frames)
+	{
+		ok = 0;
+		printf("FAIL %s: golden file has %d of %d frames\n", golden, goldenFrames, frames);
+	}
+	else if(differ)
+	{
+		ok = 0;
+		printf("FAIL %s: %d of %d frames differ, first video %d, first audio %d\n", golden, differ, frames, firstVideo, firstAudio);
+	}
+	else
+	{
+		ok = 1;
+		printf("PASS %s: %d frames\n", golden, frames);
+	}
+	free(events);
+	free(hashes);
+	free(expected);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	const char *listPath = "tests/regress.txt";
+	char line[4096], rom[1024], script[1024], golden[1024];
+	int update = 0, verbose = 0;
+	int frames, i, cases = 0, failed = 0;
+	intv_machine *m;
+	FILE *list;
+
+	for(i=1; i<argc; i++)
+	{
+		if(strcmp(argv[i], "-u") == 0) { update = 1; }
+		else if(strcmp(argv[i], "-v") == 0) { verbose = 1; }
+		else if(argv[i][0] == '-')
+		{
+			printf("usage: %s [-u] [-v] [caselist]\n", argv[0]);
+			return 2;
+		}
+		else { listPath = argv[i]; }
+	}
+	if((list = fopen(listPath, "r")) == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Can't read %s\n", listPath);
+		return 2;
+	}
+	IntvInitTables();
+	m = IntvCreate();
+	if(m == NULL)
+	{
+		printf("[ERROR] [FREEINTV] Out of memory\n");
+		fclose(list);
+		return 2;
+	}
+
+	cases++;
+	if(!checkDirtyPages(m)) { failed++; }
+	while(fgets(line, sizeof(line), list) != NULL)
+	{
+		if(line[0] == '#' || sscanf(line, "%1023s %d %1023s %1023s", rom, &frames, script, golden) != 4) { continue; }
+		cases++;
+		if(!runCase(m, rom, frames, script, golden, update, verbose)) { failed++; }
+	}
+	fclose(list);
+	IntvDestroy(m);
+
+	printf("%d of %d cases %s\n", cases - failed, cases, update ? "written" : "passed");
+	return failed ? 1 : 0;
+}
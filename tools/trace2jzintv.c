@@ -0,0 +1,70 @@
+/*
+	This file is part of FreeIntv.
+
+	FreeIntv is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	FreeIntv is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with FreeIntv; if not, write to the Free Software Foundation, Inc.,
+	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Decode a FreeIntv execution trace into the jzIntv debugger text format
+//   trace2jzintv freeintv_trace.bin > trace.txt
+
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+int main(int argc, char **argv)
+{
+	FILE *fp;
+	char magic[8];
+	char name[0x400][8];
+	uint32_t head[2];
+	uint32_t i;
+	struct trace_record t;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s trace.bin\n", argv[0]);
+		return 1;
+	}
+	if((fp = fopen(argv[1], "rb")) == NULL)
+	{
+		fprintf(stderr, "can't open %s\n", argv[1]);
+		return 1;
+	}
+	if(fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, TRACE_MAGIC, 8) != 0 ||
+	   fread(head, sizeof(head), 1, fp) != 1 || head[0] != sizeof(struct trace_record) ||
+	   fread(name, sizeof(name), 1, fp) != 1)
+	{
+		fprintf(stderr, "%s is not a FreeIntv trace\n", argv[1]);
+		fclose(fp);
+		return 1;
+	}
+
+	for(i=0; i<head[1] && fread(&t, sizeof(t), 1, fp) == 1; i++)
+	{
+		printf(" %04X %04X %04X %04X %04X %04X %04X %04X %c%c%c%c%c%c%c%c %20s %u\n",
+			t.R[0], t.R[1], t.R[2], t.R[3], t.R[4], t.R[5], t.R[6], t.R[7],
+			t.flags & TRACE_S ? 'S' : '-',
+			t.flags & TRACE_Z ? 'Z' : '-',
+			t.flags & TRACE_O ? 'O' : '-',
+			t.flags & TRACE_C ? 'C' : '-',
+			t.flags & TRACE_I ? 'I' : '-',
+			t.flags & TRACE_D ? 'D' : '-',
+			t.flags & TRACE_i ? 'i' : '-',
+			t.flags & TRACE_q ? 'q' : '-',
+			t.instruction < 0x400 ? name[t.instruction] : "???", (unsigned)t.cycle);
+	}
+	fclose(fp);
+	return 0;
+}